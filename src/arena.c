@@ -0,0 +1,91 @@
+#include "arena.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define ARENA_ALIGN 16
+#define ARENA_BLOCK_SIZE (64 * 1024)
+#define ARENA_MMAP_THRESHOLD (1024 * 1024)
+
+/* keep the data after the header aligned */
+#define BLOCK_HEADER_SIZE ((sizeof(arena_block_t) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+static arena_block_t *new_block(size_t size) {
+    arena_block_t *block;
+    bool mapped = size + BLOCK_HEADER_SIZE >= ARENA_MMAP_THRESHOLD;
+    if (mapped) {
+        block = mmap(NULL, size + BLOCK_HEADER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+        if (block == MAP_FAILED)
+            return NULL;
+    }
+    else {
+        block = malloc(size + BLOCK_HEADER_SIZE);
+        if (block == NULL)
+            return NULL;
+    }
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    block->mapped = mapped;
+    return block;
+}
+
+static void free_block(arena_block_t *block) {
+    if (block->mapped)
+        munmap(block, block->size + BLOCK_HEADER_SIZE);
+    else
+        free(block);
+}
+
+void *arena_alloc(arena_t *arena, const size_t len) {
+    size_t aligned_len = (len + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    arena_block_t *block = arena->head;
+    if (block == NULL || block->size - block->used < aligned_len) {
+        /* grow geometrically so a round needs few blocks */
+        size_t size = arena->total > ARENA_BLOCK_SIZE ? arena->total : ARENA_BLOCK_SIZE;
+        if (size < aligned_len)
+            size = aligned_len;
+        block = new_block(size);
+        if (block == NULL)
+            return NULL;
+        block->next = arena->head;
+        arena->head = block;
+        arena->total += size;
+    }
+    void *ptr = (char *)block + BLOCK_HEADER_SIZE + block->used;
+    block->used += aligned_len;
+    return ptr;
+}
+
+void *arena_calloc(arena_t *arena, const size_t len) {
+    void *ptr = arena_alloc(arena, len);
+    if (ptr != NULL)
+        memset(ptr, 0, len);
+    return ptr;
+}
+
+void arena_reset(arena_t *arena) {
+    if (arena->head == NULL)
+        return;
+    if (arena->head->next == NULL) {
+        arena->head->used = 0;
+        return;
+    }
+    size_t total = arena->total;
+    arena_release(arena);
+    arena->head = new_block(total);
+    if (arena->head != NULL)
+        arena->total = total;
+}
+
+void arena_release(arena_t *arena) {
+    arena_block_t *block = arena->head;
+    while (block != NULL) {
+        arena_block_t *next = block->next;
+        free_block(block);
+        block = next;
+    }
+    arena->head = NULL;
+    arena->total = 0;
+}
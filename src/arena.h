@@ -0,0 +1,34 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+typedef struct arena_block {
+    struct arena_block *next;
+    size_t size;  /* usable size */
+    size_t used;
+    bool mapped;  /* large blocks come from mmap */
+} arena_block_t;
+
+typedef struct {
+    arena_block_t *head;
+    size_t total;  /* sum of block sizes */
+} arena_t;
+
+#define ARENA_INIT {NULL, 0}
+
+/* bump allocation, 16 bytes aligned, never freed individually */
+void *arena_alloc(arena_t *arena, const size_t len);
+
+void *arena_calloc(arena_t *arena, const size_t len);
+
+/* 
+ * drop everything but keep the capacity,
+ * blocks are merged into one so the next round needs no allocation
+ */
+void arena_reset(arena_t *arena);
+
+void arena_release(arena_t *arena);
+
+#endif
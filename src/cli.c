@@ -9,18 +9,61 @@ work_mode_t o_mode = LOOKUP_MODE;
 char *o_symbol, *o_file;
 int o_patch_arch = 0;
 data_t o_patch_data = {0, NULL};
+data_t o_expect_data = {0, NULL};
 bool o_use_builtin_patch = false;
 int o_builtin_idx = -1;
+payload_t *o_payload = NULL;
 bool o_quiet = false;
+char *o_manifest = NULL;
+char *o_image = NULL;
+bool o_json = false;
+
+int parse_hex(const char *str, data_t *out) {
+    size_t xlen = 0;
+    size_t buf_size = (strlen(str) + 1) >> 1;
+    uint8_t *xbuf = malloc(buf_size);
+    memset(xbuf, 0, buf_size);
+    for (int i = 0; str[i]; i++) {
+        char ch = str[i];
+        if (ch >= '0' && ch <= '9') xbuf[xlen>>1] |= (ch-'0') << (((xlen+1)%2)*4), ++xlen;
+        else if (ch >= 'A' && ch <= 'F') xbuf[xlen>>1] |= (ch-'A'+10) << (((xlen+1)%2)*4), ++xlen;
+        else if (ch >= 'a' && ch <= 'f') xbuf[xlen>>1] |= (ch-'a'+10) << (((xlen+1)%2)*4), ++xlen;
+        else if (ch != ' ' && ch != '\t' && ch != '\r' && ch != '\n') {
+            fprintf(stderr, "symp: invalid character '%c' in hex string\n", ch);
+            free(xbuf);
+            return 1;
+        }
+    }
+    if (xlen%2 != 0) {
+        fprintf(stderr, "symp: hex string length should be oven\n");
+        free(xbuf);
+        return 1;
+    }
+    out->len = xlen >> 1;
+    out->buf = xbuf;
+    return 0;
+}
 
 static void usage() {
     puts("symp - a symbol patching tool");
     puts("usage: symp [options] -- <symbol> <file>");
+    puts("       symp --where [options] -- <symbol> <dir>");
+    puts("       symp --watch <manifest> [options]");
+    puts("       symp --apply <manifest> [options]");
+    puts("       symp --revert <file> [options]");
     puts("options:");
     puts("  -a, --arch <arch>         arch of the binary to be patched, only x86_64 and arm64 are supported");
-    puts("  -p, --patch <patch>       use builtin patches, available: ret, ret0, ret1, ret2");
+    puts("  -p, --patch <patch>       use builtin patches (ret, ret0, ret1, ret2), or compile one from");
+    puts("                            'ret [imm]', 'mov <imm>', 'b <symbol|addr>', 'nop <len>' separated by ';'");
     puts("  -b, --binary <binary>     use a binary file as patch");
     puts("  -x, --hex <hex string>    hex string of the patch");
+    puts("  -e, --expect <hex string> only patch when the original bytes match (patched ones are skipped)");
+    puts("  -i, --image <name>        install name or file name of the image, for dyld shared caches");
+    puts("  -w, --where               find the images under <dir> that define the symbol");
+    puts("      --watch <manifest>    keep the patches of a manifest applied when the binaries change");
+    puts("      --apply <manifest>    apply the patches of a manifest once, resolved symbols are cached");
+    puts("      --revert <file>       restore the original bytes of the sites patched by symp");
+    puts("      --json                print lookup and --where matches as NDJSON records");
     puts("  -q, --quiet               suppress match count messages (useful for command substitution)");
 }
 
@@ -38,12 +81,19 @@ int parse_arguments(int argc, char **argv) {
             {"patch",  required_argument, 0, 'p'},
             {"binary", required_argument, 0, 'b'},
             {"hex",    required_argument, 0, 'x'},
+            {"expect", required_argument, 0, 'e'},
+            {"image",  required_argument, 0, 'i'},
+            {"where",  no_argument, 0, 'w'},
+            {"watch",  required_argument, 0, 'W'},
+            {"apply",  required_argument, 0, 'A'},
+            {"revert", required_argument, 0, 'R'},
+            {"json",   no_argument, 0, 'J'},
             {"quiet",  no_argument, 0, 'q'},
             {"help",   no_argument, 0, 'h'},
             {0, 0, 0, 0}
         };
         int option_index = 0;
-        int c = getopt_long(argc, argv, "a:p:b:x:qh", long_options, &option_index);
+        int c = getopt_long(argc, argv, "a:p:b:x:e:i:wqh", long_options, &option_index);
         if (c == -1)
             break;
         switch (c) {
@@ -87,35 +137,46 @@ int parse_arguments(int argc, char **argv) {
                     break;
                 }
             }
-            if (o_builtin_idx == -1) {
-                fprintf(stderr, "symp: unknow patch %s\n", optarg);
+            /* not a builtin one, compile it for each site */
+            if (o_builtin_idx == -1 && (o_payload = parse_payload(optarg)) == NULL)
                 goto err;
-            }
             break;
         case 'x':
             if (xbuf || o_use_builtin_patch) {
                 fprintf(stderr, "symp: only one of -p/-b/-x should be offered\n");
                 goto err;
             }
-            xlen = 0;
-            size_t buf_size = strlen(optarg) >> 1;
-            xbuf = malloc(buf_size);
-            memset(xbuf, 0, buf_size);
-            for (int i = 0; optarg[i]; i++) {
-                char ch = optarg[i];
-                if (ch >= '0' && ch <= '9') xbuf[xlen>>1] |= (ch-'0') << (((xlen+1)%2)*4), ++xlen;
-                else if (ch >= 'A' && ch <= 'F') xbuf[xlen>>1] |= (ch-'A'+10) << (((xlen+1)%2)*4), ++xlen;
-                else if (ch >= 'a' && ch <= 'f') xbuf[xlen>>1] |= (ch-'a'+10) << (((xlen+1)%2)*4), ++xlen;
-                else if (ch != ' ' && ch != '\t' && ch != '\r' && ch != '\n') {
-                    fprintf(stderr, "symp: invalid character '%c' in hex string\n", ch);
-                    goto err;
-                }
-            }
-            if (xlen%2 != 0) {
-                fprintf(stderr, "symp: hex string length should be oven\n");
+            data_t hex_data;
+            if (parse_hex(optarg, &hex_data) != 0)
                 goto err;
-            }
-            xlen >>= 1;
+            xlen = hex_data.len;
+            xbuf = hex_data.buf;
+            break;
+        case 'e':
+            free(o_expect_data.buf);
+            if (parse_hex(optarg, &o_expect_data) != 0)
+                goto err;
+            break;
+        case 'i':
+            o_image = optarg;
+            break;
+        case 'w':
+            o_mode = WHERE_MODE;
+            break;
+        case 'W':
+            o_mode = WATCH_MODE;
+            o_manifest = optarg;
+            break;
+        case 'A':
+            o_mode = APPLY_MODE;
+            o_manifest = optarg;
+            break;
+        case 'R':
+            o_mode = REVERT_MODE;
+            o_file = optarg;
+            break;
+        case 'J':
+            o_json = true;
             break;
         case 'q':
             o_quiet = true;
@@ -124,6 +185,7 @@ int parse_arguments(int argc, char **argv) {
             usage();
             o_mode = USAGE_MODE;
             free(xbuf);
+            free_payload(o_payload);
             return 0;
         case '?':
             goto err;
@@ -132,6 +194,31 @@ int parse_arguments(int argc, char **argv) {
         }
     }
 
+    if (o_mode == WATCH_MODE || o_mode == APPLY_MODE) {
+        const char *option = o_mode == WATCH_MODE ? "--watch" : "--apply";
+        if (xbuf != NULL || o_use_builtin_patch || o_expect_data.buf != NULL || argc != optind) {
+            fprintf(stderr, "symp: %s takes patches from the manifest only\n", option);
+            goto err;
+        }
+        if (o_json) {
+            fprintf(stderr, "symp: --json can not be used with %s\n", option);
+            goto err;
+        }
+        return 0;
+    }
+
+    if (o_mode == REVERT_MODE) {
+        if (xbuf != NULL || o_use_builtin_patch || o_expect_data.buf != NULL || argc != optind) {
+            fprintf(stderr, "symp: --revert takes the original bytes from the undo log only\n");
+            goto err;
+        }
+        if (o_json || o_image != NULL) {
+            fprintf(stderr, "symp: --json and -i can not be used with --revert\n");
+            goto err;
+        }
+        return 0;
+    }
+
     if (argc - optind != 2) {
         if (argc - optind < 2)
             fprintf(stderr, "symp: arguments not enough!\n");
@@ -140,7 +227,17 @@ int parse_arguments(int argc, char **argv) {
         goto err;
     }
 
-    if (xbuf != NULL) {
+    if (o_mode == WHERE_MODE) {
+        if (xbuf != NULL || o_use_builtin_patch) {
+            fprintf(stderr, "symp: -w can not be used with -p/-b/-x\n");
+            goto err;
+        }
+        if (o_image != NULL) {
+            fprintf(stderr, "symp: -i can not be used with -w\n");
+            goto err;
+        }
+    }
+    else if (xbuf != NULL) {
         o_mode = PATCH_MODE;
         o_patch_data.len = xlen;
         o_patch_data.buf = xbuf;
@@ -148,11 +245,21 @@ int parse_arguments(int argc, char **argv) {
     else if (o_use_builtin_patch) {
         o_mode = PATCH_MODE;
     }
+    if (o_json && o_mode == PATCH_MODE) {
+        fprintf(stderr, "symp: --json can not be used with -p/-b/-x\n");
+        goto err;
+    }
+    if (o_expect_data.buf != NULL && o_mode != PATCH_MODE) {
+        fprintf(stderr, "symp: -e should be used with one of -p/-b/-x\n");
+        goto err;
+    }
     o_symbol = argv[optind++];
     o_file = argv[optind++];
     return 0;
 
 err:
     free(xbuf);
+    free_payload(o_payload);
+    o_payload = NULL;
     return 1;
 }
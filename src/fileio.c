@@ -1,6 +1,11 @@
 #include "fileio.h"
 
+#include <errno.h>
+#include <pthread.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 void *read_file(FILE *fp, const size_t len) {
     void *data = malloc(len);
@@ -16,3 +21,100 @@ void *read_file_off(FILE *fp, const size_t len, const long int offset) {
     fseek(fp, offset, SEEK_SET);
     return read_file(fp, len);
 }
+
+void *read_file_arena(arena_t *arena, FILE *fp, const size_t len) {
+    void *data = arena_alloc(arena, len);
+    if (data == NULL || (len != 0 && fread(data, len, 1, fp) != 1)) {
+        perror("read_file");
+        return NULL;
+    }
+    return data;
+}
+
+void *read_file_off_arena(arena_t *arena, FILE *fp, const size_t len, const long int offset) {
+    fseek(fp, offset, SEEK_SET);
+    return read_file_arena(arena, fp, len);
+}
+
+static int mkdir_p(char *path) {
+    for (char *p = path + 1; *p; p++) {
+        if (*p != '/')
+            continue;
+        *p = '\0';
+        int ret = mkdir(path, 0755);
+        *p = '/';
+        if (ret != 0 && errno != EEXIST)
+            return 1;
+    }
+    if (mkdir(path, 0755) != 0 && errno != EEXIST)
+        return 1;
+    return 0;
+}
+
+/* (g)lobals, set once, cache paths are also built by prefetch threads */
+static pthread_once_t g_cache_dir_once = PTHREAD_ONCE_INIT;
+static char *g_cache_dir = NULL;
+
+static void init_cache_dir(void) {
+    char dir[4096];
+    const char *env = getenv("SYMP_CACHE_DIR");
+    const char *home = getenv("HOME");
+    if (env != NULL && env[0] != '\0')
+        snprintf(dir, sizeof(dir), "%s", env);
+#ifdef __APPLE__
+    else if (home != NULL)
+        snprintf(dir, sizeof(dir), "%s/Library/Caches/symp", home);
+#else
+    else if (getenv("XDG_CACHE_HOME") != NULL)
+        snprintf(dir, sizeof(dir), "%s/symp", getenv("XDG_CACHE_HOME"));
+    else if (home != NULL)
+        snprintf(dir, sizeof(dir), "%s/.cache/symp", home);
+#endif
+    else
+        return;
+    if (mkdir_p(dir) != 0)
+        return;
+    g_cache_dir = strdup(dir);
+}
+
+char *cache_file_path(const char *name) {
+    pthread_once(&g_cache_dir_once, init_cache_dir);
+    if (g_cache_dir == NULL)
+        return NULL;
+    size_t len = strlen(g_cache_dir) + strlen(name) + 2;
+    char *path = malloc(len);
+    snprintf(path, len, "%s/%s", g_cache_dir, name);
+    return path;
+}
+
+int write_file_atomic(const char *path, const void *data, const size_t len) {
+    size_t tmp_len = strlen(path) + 32;
+    char *tmp_path = malloc(tmp_len);
+    snprintf(tmp_path, tmp_len, "%s.%d.tmp", path, (int)getpid());
+    FILE *fp = fopen(tmp_path, "wb");
+    if (fp == NULL) {
+        free(tmp_path);
+        return 1;
+    }
+    int error = len != 0 && fwrite(data, len, 1, fp) != 1;
+    error |= fclose(fp) != 0;
+    if (!error)
+        error = rename(tmp_path, path) != 0;
+    if (error)
+        unlink(tmp_path);
+    free(tmp_path);
+    return error;
+}
+
+uint64_t hash_update(uint64_t hash, const char *str) {
+    return hash_bytes(hash, str, strlen(str));
+}
+
+uint64_t hash_bytes(uint64_t hash, const void *data, size_t len) {
+    const uint8_t *bytes = data;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL; /* FNV prime */
+    }
+    return hash;
+}
@@ -2,9 +2,34 @@
 #define FILEIO_H
 
 #include <stdio.h>
+#include <stdint.h>
+
+#include "arena.h"
 
 void *read_file(FILE *fp, const size_t len);
 
 void *read_file_off(FILE *fp, const size_t len, const long int offset);
 
-#endif
\ No newline at end of file
+/* same as above, but the buffer is owned by the arena */
+void *read_file_arena(arena_t *arena, FILE *fp, const size_t len);
+
+void *read_file_off_arena(arena_t *arena, FILE *fp, const size_t len, const long int offset);
+
+/* 
+ * return a malloc'd path of name in the cache directory
+ * ($SYMP_CACHE_DIR, or the user cache directory), NULL if unavailable
+ */
+char *cache_file_path(const char *name);
+
+/* write to a temporary file and rename it over path, 0 on success */
+int write_file_atomic(const char *path, const void *data, const size_t len);
+
+#define HASH_INIT 0xcbf29ce484222325ULL /* FNV-1a offset basis */
+
+/* FNV-1a of a string, can be continued from the hash of a prefix */
+uint64_t hash_update(uint64_t hash, const char *str);
+
+/* same as above, for len bytes of data */
+uint64_t hash_bytes(uint64_t hash, const void *data, size_t len);
+
+#endif
@@ -0,0 +1,164 @@
+#include "private.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * NDJSON records of matches, one per line:
+ *   {"file":"..","arch":"arm64","symbol":"..","source":"export",
+ *    "vmaddr":"0x100003f20","fileoff":"0x3f20","maxplen":16}
+ * addresses are hex strings, they do not fit in a double
+ * bytes of names that are not valid UTF-8 are escaped one by one as \u00XX
+ * records are formatted by hand into a large buffer and written out with write(2)
+ */
+
+#define JSON_BUF_SIZE (1 << 20)
+#define JSON_MAX_TOKEN 32  /* longest escape or number put at once */
+
+/* (g)lobals */
+static char g_json_buf[JSON_BUF_SIZE];
+static size_t g_json_len = 0;
+
+static const char *source_names[] = {
+    [SOURCE_ADDRESS] = "address",
+    [SOURCE_EXPORT] = "export",
+    [SOURCE_STUB] = "stub",
+    [SOURCE_SYMTAB] = "symtab",
+    [SOURCE_OBJC] = "objc"
+};
+
+void json_flush(void) {
+    for (size_t written = 0; written < g_json_len; ) {
+        ssize_t ret = write(STDOUT_FILENO, g_json_buf + written, g_json_len - written);
+        if (ret < 0 && errno == EINTR)
+            continue;
+        if (ret <= 0) {
+            perror("write");
+            break; /* e.g. a closed pipe, drop the rest */
+        }
+        written += ret;
+    }
+    g_json_len = 0;
+}
+
+/* make room for a token */
+static char *json_reserve(size_t len) {
+    if (JSON_BUF_SIZE - g_json_len < len)
+        json_flush();
+    return g_json_buf + g_json_len;
+}
+
+static void put_raw(const char *str) {
+    for (; *str; str++) {
+        *json_reserve(1) = *str;
+        g_json_len++;
+    }
+}
+
+/* length of the well-formed UTF-8 sequence at str, 0 if it is not one (overlong, surrogate, > U+10FFFF) */
+static int utf8_len(const unsigned char *str) {
+    const unsigned char c = str[0];
+    unsigned char lo = 0x80, hi = 0xBF; /* range of the second byte */
+    int len;
+    if (c < 0x80)
+        return 1;
+    else if (c >= 0xC2 && c <= 0xDF)
+        len = 2;
+    else if (c >= 0xE0 && c <= 0xEF) {
+        len = 3;
+        if (c == 0xE0)
+            lo = 0xA0;
+        else if (c == 0xED)
+            hi = 0x9F;
+    }
+    else if (c >= 0xF0 && c <= 0xF4) {
+        len = 4;
+        if (c == 0xF0)
+            lo = 0x90;
+        else if (c == 0xF4)
+            hi = 0x8F;
+    }
+    else
+        return 0;
+    if (str[1] < lo || str[1] > hi)
+        return 0;
+    /* the NUL terminator is not a continuation byte, so this stops at the end */
+    for (int i = 2; i < len; i++) {
+        if ((str[i] & 0xC0) != 0x80)
+            return 0;
+    }
+    return len;
+}
+
+static void put_string(const char *str) {
+    static const char hex_digits[] = "0123456789abcdef";
+    *json_reserve(1) = '"';
+    g_json_len++;
+    for (const unsigned char *cur_pos = (const void *)str; *cur_pos; ) {
+        char *out = json_reserve(JSON_MAX_TOKEN);
+        const unsigned char c = *cur_pos;
+        const int len = utf8_len(cur_pos);
+        if (c == '"' || c == '\\')
+            out[0] = '\\', out[1] = c, g_json_len += 2;
+        else if (c < 0x20 || len == 0) {
+            memcpy(out, "\\u00", 4);
+            out[4] = hex_digits[c >> 4];
+            out[5] = hex_digits[c & 0xF];
+            g_json_len += 6;
+        }
+        else {
+            memcpy(out, cur_pos, len);
+            g_json_len += len;
+        }
+        cur_pos += len != 0 ? len : 1;
+    }
+    *json_reserve(1) = '"';
+    g_json_len++;
+}
+
+static void put_hex(uint64_t value) {
+    static const char hex_digits[] = "0123456789abcdef";
+    char *out = json_reserve(JSON_MAX_TOKEN);
+    int ndigits = 1;
+    while (ndigits < 16 && (value >> (ndigits * 4)) != 0)
+        ndigits++;
+    out[0] = '"', out[1] = '0', out[2] = 'x';
+    for (int i = 0; i < ndigits; i++)
+        out[3 + i] = hex_digits[(value >> ((ndigits - 1 - i) * 4)) & 0xF];
+    out[3 + ndigits] = '"';
+    g_json_len += ndigits + 4;
+}
+
+static void put_uint(uint64_t value) {
+    char digits[20];
+    int ndigits = 0;
+    do {
+        digits[ndigits++] = '0' + value % 10;
+        value /= 10;
+    } while (value != 0);
+    char *out = json_reserve(JSON_MAX_TOKEN);
+    for (int i = 0; i < ndigits; i++)
+        out[i] = digits[ndigits - 1 - i];
+    g_json_len += ndigits;
+}
+
+void json_record(const char *file, const char *symbol, const patch_off_t *poff) {
+    const char *arch = arch2str(poff->cputype);
+    put_raw("{\"file\":");
+    put_string(file);
+    put_raw(",\"arch\":");
+    put_string(arch ? arch : "unknown");
+    put_raw(",\"symbol\":");
+    put_string(symbol);
+    put_raw(",\"source\":");
+    put_string(source_names[poff->source]);
+    put_raw(",\"vmaddr\":");
+    put_hex(poff->vmaddr);
+    put_raw(",\"fileoff\":");
+    put_hex(poff->fileoff);
+    put_raw(",\"maxplen\":");
+    put_uint(poff->maxplen);
+    put_raw("}\n");
+}
@@ -5,66 +5,88 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
-#include <mach-o/fat.h>
-#include <mach-o/dyld.h>
 #include <mach-o/loader.h>
 
-typedef struct {
-    int32_t cputype;
-    char *name;
-} arch_name_t;
-
-static const arch_name_t cpu_archs[] = {
-    {CPU_TYPE_X86_64, "x86_64"},
-    {CPU_TYPE_ARM64, "arm64"}
-};
-
 /* (g)lobals */
 static int32_t g_searched_arch = 0;
 
-static char *arch2str(int32_t arch) {
-    for (int i = 0; i < ARRAY_LEN(cpu_archs); i++) {
-        if (arch == cpu_archs[i].cputype)
-            return cpu_archs[i].name;
+typedef struct {
+    int npoffs;
+    patch_off_t poffs[2]; /* only two archs are supported currently */
+    uint64_t targets[2];  /* branch target of o_payload for each poff */
+    uint8_t uuids[2][16]; /* LC_UUID of the slice of each poff, zero in dyld shared caches */
+} lookup_result_t;
+
+/* resolve the branch of o_payload in the image of the symbol */
+static bool find_branch_target(FILE *fp, long offset, dyld_cache_t *cache, lookup_result_t *result) {
+    if (o_payload == NULL || o_payload->target == NULL)
+        return true;
+    patch_off_t target;
+    bool found;
+    if (cache != NULL)
+        found = lookup_symbol_dyld_cache(cache, o_image, o_payload->target, &target);
+    else {
+        fseek(fp, offset, SEEK_SET);
+        found = lookup_symbol_macho(fp, o_payload->target, &target);
     }
-    return NULL;
+    if (!found) {
+        char *arch = arch2str(result->poffs[result->npoffs].cputype);
+        fprintf(stderr, "symp: branch target '%s' not found for arch '%s'!\n", o_payload->target, arch ? arch : "unknown");
+        return false;
+    }
+    result->targets[result->npoffs] = target.vmaddr;
+    return true;
 }
 
-int find_symbol(FILE *fp, int offset, int32_t cputype, patch_off_t *poffs) {
+static int find_symbol(FILE *fp, long offset, int32_t cputype, void *ctx) {
+    lookup_result_t *result = ctx;
     int found = 0;
     if (o_patch_arch == 0 || (cputype & o_patch_arch) == cputype) {
         g_searched_arch |= cputype;
-        fseek(fp, offset, SEEK_SET);
-        if (lookup_symbol_macho(fp, o_symbol, poffs))
+        if (result->npoffs == ARRAY_LEN(result->poffs)) {
+            fprintf(stderr, "symp: too many slices for arch '%s'!\n", arch2str(cputype));
+            return 0;
+        }
+        if (lookup_symbol_macho(fp, o_symbol, result->poffs + result->npoffs)) {
+            if (!find_branch_target(fp, offset, NULL, result))
+                return 0;
+            fseek(fp, offset, SEEK_SET);
+            lookup_uuid_macho(fp, result->uuids[result->npoffs]);
+            result->npoffs++;
             found = 1;
+        }
         else
             fprintf(stderr, "symbol not found for arch '%s'!\n", arch2str(cputype));
     }
     return found;
 }
 
-int patch_file(FILE* fp, patch_off_t poff) {
-    const data_t *final_patch = &o_patch_data;
-    if (o_use_builtin_patch) {
-        if (poff.cputype == CPU_TYPE_X86_64)
-            final_patch = &builtin_patches[o_builtin_idx].x86_64_p;
-        else if (poff.cputype == CPU_TYPE_ARM64)
-            final_patch = &builtin_patches[o_builtin_idx].arm64_p;
-        else {
-            fprintf(stderr, "symp: unknown arch in patch_off_t!\n");
-            return 1;
-        }
-    }
-    if (poff.maxplen != 0 && final_patch->len > poff.maxplen) {
-        fprintf(stderr, "symp: patch length(%zu) exceeded! (max %d)\n", final_patch->len, poff.maxplen);
-        return 1;
+static void find_symbol_cache(dyld_cache_t *cache, lookup_result_t *result) {
+    int32_t cputype = dyld_cache_cputype(cache);
+    if (o_patch_arch != 0 && (cputype & o_patch_arch) != cputype)
+        return;
+    g_searched_arch |= cputype;
+    if (lookup_symbol_dyld_cache(cache, o_image, o_symbol, result->poffs + result->npoffs)) {
+        if (find_branch_target(NULL, 0, cache, result))
+            result->npoffs++;
     }
-    fseek(fp, poff.fileoff, SEEK_SET);
-    if (fwrite(final_patch->buf, final_patch->len, 1, fp) != 1) {
-        perror("fwrite");
-        return 1;
-    }
-    return 0;
+    else
+        fprintf(stderr, "symbol not found for arch '%s'!\n", arch2str(cputype));
+}
+
+/* the patch offered on the command line for a site, compiled into out if it is a payload */
+static const data_t *patch_for_site(const patch_off_t *poff, uint64_t target, data_t *out) {
+    const int32_t cputype = poff->cputype;
+    if (!o_use_builtin_patch)
+        return &o_patch_data;
+    if (o_payload != NULL)
+        return compile_payload(o_payload, cputype, poff->vmaddr, target, out) == 0 ? out : NULL;
+    if (cputype == CPU_TYPE_X86_64)
+        return &builtin_patches[o_builtin_idx].x86_64_p;
+    else if (cputype == CPU_TYPE_ARM64)
+        return &builtin_patches[o_builtin_idx].arm64_p;
+    fprintf(stderr, "symp: unknown arch in patch_off_t!\n");
+    return NULL;
 }
 
 int main(int argc, char **argv) {
@@ -75,8 +97,26 @@ int main(int argc, char **argv) {
     if (o_mode == USAGE_MODE)
         return 0; /* already printed */
 
-    int npoffs = 0;
-    patch_off_t poffs[2]; /* only two archs are supported currently */
+    if (o_mode == WATCH_MODE)
+        return watch_manifest(o_manifest);
+
+    if (o_mode == APPLY_MODE)
+        return apply_manifest(o_manifest);
+
+    if (o_mode == REVERT_MODE)
+        return revert_file(o_file);
+
+    if (o_mode == WHERE_MODE) {
+        error = where_symbol(o_symbol, o_file);
+        release_lookup_state();
+        return error;
+    }
+
+    lookup_result_t result = {0};
+    patch_off_t *poffs = result.poffs;
+    dyld_cache_t *cache = NULL;
+    FILE *patch_fp = NULL;
+    data_t compiled[ARRAY_LEN(result.poffs)] = {0};
 
     char *fmode = "rb";
     if (o_mode == PATCH_MODE)
@@ -87,39 +127,24 @@ int main(int argc, char **argv) {
         return 1;
     }
 
-    uint32_t file_magic;
-    fread(&file_magic, sizeof(uint32_t), 1, fp);
-    switch(file_magic) {
-    case MH_MAGIC_64: { /* 64-bit Mach-O file */
-        int32_t cputype;
-        fread(&cputype, sizeof(int32_t), 1, fp);
-        npoffs += find_symbol(fp, 0, cputype, poffs);
-        break;
-    }
-    case FAT_CIGAM: { /* FAT file (on little-endian host CPU) */
-        uint32_t nfat_arch;
-        fread(&nfat_arch, sizeof(int32_t), 1, fp);
-        nfat_arch = OSSwapInt32(nfat_arch);
-        size_t total_size = nfat_arch * sizeof(struct fat_arch);
-        struct fat_arch *archs = read_file(fp, total_size);
-        for (int i = 0; i < nfat_arch; i++) {
-            const int32_t cputype = OSSwapInt32(archs[i].cputype);
-            const int32_t offset = OSSwapInt32(archs[i].offset);
-            npoffs += find_symbol(fp, offset, cputype, poffs + npoffs);
+    if (for_each_slice(fp, find_symbol, &result) < 0) {
+        cache = open_dyld_cache(o_file);
+        if (cache == NULL) {
+            fprintf(stderr, "symp: not a valid Mach-O, FAT or dyld shared cache file\n");
+            error = 1;
+            goto err_ret;
         }
-        free(archs);
-        break;
-    }
-    default:
-        fprintf(stderr, "symp: not a valid Mach-O or FAT file\n");
-        goto err_ret;
+        find_symbol_cache(cache, &result);
     }
+    else if (o_image != NULL)
+        fprintf(stderr, "symp: warning, -i is only used for dyld shared caches\n");
+    const int npoffs = result.npoffs;
 
     /* offered arch option but some arch is missing.. */
     if (o_patch_arch != 0 && g_searched_arch != o_patch_arch) {
         error = 1;
         int32_t unsearched_arch = o_patch_arch ^ g_searched_arch;
-        for (int i = 0; i < ARRAY_LEN(cpu_archs); i++) {
+        for (int i = 0; i < cpu_archs_count; i++) {
             if ((unsearched_arch & cpu_archs[i].cputype) == cpu_archs[i].cputype)
                 fprintf(stderr, "symp: offered arch '%s' not found in the file\n", cpu_archs[i].name);
         }
@@ -128,13 +153,22 @@ int main(int argc, char **argv) {
 
     if (npoffs == 0) {
         error = 1;
-        printf("no matches found!\n");
+        if (!o_json)
+            printf("no matches found!\n");
         goto err_ret;
     }
 
-    if (o_mode == LOOKUP_MODE) {
+    if (o_mode == LOOKUP_MODE && o_json) {
+        for (int i = 0; i < npoffs; i++)
+            json_record(poffs[i].path != NULL ? poffs[i].path : o_file, o_symbol, &poffs[i]);
+        json_flush();
+    }
+    else if (o_mode == LOOKUP_MODE) {
         for (int i = 0; i < npoffs; i++) {
-            printf("0x%lx\n", poffs[i].fileoff);
+            if (poffs[i].path != NULL)
+                printf("0x%lx %s\n", poffs[i].fileoff, poffs[i].path);
+            else
+                printf("0x%lx\n", poffs[i].fileoff);
         }
         if (!o_quiet) {
             // one match for an arch at most
@@ -145,20 +179,42 @@ int main(int argc, char **argv) {
         }
     }
     else if (o_mode == PATCH_MODE) {
-        int patched = 0;
-        for (; patched < npoffs; patched++) {
-            if (patch_file(fp, poffs[patched]) != 0) {
+        patch_site_t sites[ARRAY_LEN(result.poffs)];
+        for (int i = 0; i < npoffs; i++) {
+            sites[i].poff = poffs[i];
+            sites[i].patch = patch_for_site(&poffs[i], result.targets[i], &compiled[i]);
+            sites[i].expect = o_expect_data.buf != NULL ? &o_expect_data : NULL;
+            sites[i].uuid = result.uuids[i];
+            if (sites[i].patch == NULL) {
                 error = 1;
-                break;
+                goto err_ret;
             }
         }
-        if (patched == 1)
-            printf("1(%d) match patched\n", npoffs);
-        else {
-            if (!o_use_builtin_patch)
-                fprintf(stderr, "symp: warning, multiple arches used the same patch\n");
-            printf("%d(%d) matches patched\n", patched, npoffs);
+        /* a symbol of a dyld shared cache may be in a subcache */
+        patch_fp = fp;
+        if (poffs[0].path != NULL && (patch_fp = fopen(poffs[0].path, "rb+")) == NULL) {
+            perror("fopen");
+            error = 1;
+            goto err_ret;
         }
+        if (patch_file(patch_fp, poffs[0].path != NULL ? poffs[0].path : o_file, sites, npoffs) != 0)
+            error = 1;
+        int patched = 0, already = 0;
+        for (int i = 0; i < npoffs; i++) {
+            if (sites[i].status == PATCH_WRITTEN)
+                patched++;
+            else if (sites[i].status == PATCH_ALREADY)
+                already++;
+        }
+        if (npoffs > 1 && !o_use_builtin_patch)
+            fprintf(stderr, "symp: warning, multiple arches used the same patch\n");
+        if (patched == 1)
+            printf("1(%d) match patched", npoffs);
+        else
+            printf("%d(%d) matches patched", patched, npoffs);
+        if (already != 0)
+            printf(", %d already-patched", already);
+        printf("\n");
     }
     else {
         error = 1;
@@ -166,7 +222,16 @@ int main(int argc, char **argv) {
     }
 
 err_ret:
+    release_lookup_state();
+    if (patch_fp != NULL && patch_fp != fp)
+        fclose(patch_fp);
+    if (cache != NULL)
+        close_dyld_cache(cache);
     fclose(fp);
+    for (int i = 0; i < ARRAY_LEN(compiled); i++)
+        free(compiled[i].buf);
+    free_payload(o_payload);
     free(o_patch_data.buf);
+    free(o_expect_data.buf);
     return error;
 }
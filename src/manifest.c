@@ -0,0 +1,227 @@
+#include "private.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <mach-o/loader.h>
+
+/*
+ * manifest format, one patch site per line, '#' starts a comment:
+ *   <file> <symbol> <patch>...
+ * fields are separated by spaces, use "" for fields containing spaces
+ * patch is a builtin patch name, a payload without branches (see payload.c)
+ * or hex bytes, optionally prefixed with 'x86_64:' or 'arm64:' to offer it
+ * for a single arch
+ * 'expect:<hex>' (with the same arch prefixes) only patches when the
+ * original bytes match
+ * relative file paths are relative to the manifest
+ */
+
+#define MAX_FIELDS 8
+
+/* split a line in place, return the number of fields or -1 on error */
+static int split_fields(char *line, char **fields) {
+    int nfields = 0;
+    char *p = line;
+    while (1) {
+        while (*p == ' ' || *p == '\t' || *p == '\r')
+            p++;
+        if (*p == '\0' || *p == '#')
+            break;
+        if (nfields == MAX_FIELDS)
+            return -1;
+        if (*p == '"') {
+            fields[nfields++] = ++p;
+            p = strchr(p, '"');
+            if (p == NULL)
+                return -1;
+        }
+        else {
+            fields[nfields++] = p;
+            while (*p && *p != ' ' && *p != '\t' && *p != '\r')
+                p++;
+            if (*p == '\0')
+                break;
+        }
+        *p++ = '\0';
+    }
+    return nfields;
+}
+
+static void copy_data(data_t *dst, const data_t *src) {
+    free(dst->buf);
+    dst->len = src->len;
+    dst->buf = malloc(src->len);
+    memcpy(dst->buf, src->buf, src->len);
+}
+
+/* starts with a payload statement rather than hex bytes */
+static bool is_payload(const char *field) {
+    static const char *keywords[] = {"ret", "mov", "nop", "b"};
+    size_t len = strcspn(field, " \t;");
+    for (int i = 0; i < ARRAY_LEN(keywords); i++) {
+        if (strlen(keywords[i]) == len && strncmp(field, keywords[i], len) == 0)
+            return true;
+    }
+    return false;
+}
+
+static int parse_patch(const char *field, manifest_entry_t *entry) {
+    int32_t arch = CPU_TYPE_X86_64 | CPU_TYPE_ARM64;
+    if (strncmp(field, "x86_64:", 7) == 0)
+        arch = CPU_TYPE_X86_64, field += 7;
+    else if (strncmp(field, "arm64:", 6) == 0)
+        arch = CPU_TYPE_ARM64, field += 6;
+    if (strncmp(field, "expect:", 7) == 0) {
+        data_t hex_data;
+        if (parse_hex(field + 7, &hex_data) != 0)
+            return 1;
+        if ((arch & CPU_TYPE_X86_64) == CPU_TYPE_X86_64)
+            copy_data(&entry->x86_64_e, &hex_data);
+        if ((arch & CPU_TYPE_ARM64) == CPU_TYPE_ARM64)
+            copy_data(&entry->arm64_e, &hex_data);
+        free(hex_data.buf);
+        return 0;
+    }
+    for (int i = 0; i < builtin_patches_count; i++) {
+        if (strcmp(builtin_patches[i].name, field) == 0) {
+            if ((arch & CPU_TYPE_X86_64) == CPU_TYPE_X86_64)
+                copy_data(&entry->x86_64_p, &builtin_patches[i].x86_64_p);
+            if ((arch & CPU_TYPE_ARM64) == CPU_TYPE_ARM64)
+                copy_data(&entry->arm64_p, &builtin_patches[i].arm64_p);
+            return 0;
+        }
+    }
+    if (is_payload(field)) {
+        payload_t *payload = parse_payload(field);
+        if (payload == NULL)
+            return 1;
+        int error = 0;
+        data_t compiled;
+        if (payload->target != NULL) {
+            fprintf(stderr, "symp: branches are only supported by -p\n");
+            error = 1;
+        }
+        /* no branch, so the bytes do not depend on the site */
+        if (!error && (arch & CPU_TYPE_X86_64) == CPU_TYPE_X86_64 &&
+            (error = compile_payload(payload, CPU_TYPE_X86_64, 0, 0, &compiled)) == 0) {
+            free(entry->x86_64_p.buf);
+            entry->x86_64_p = compiled;
+        }
+        if (!error && (arch & CPU_TYPE_ARM64) == CPU_TYPE_ARM64 &&
+            (error = compile_payload(payload, CPU_TYPE_ARM64, 0, 0, &compiled)) == 0) {
+            free(entry->arm64_p.buf);
+            entry->arm64_p = compiled;
+        }
+        free_payload(payload);
+        return error;
+    }
+    data_t hex_data;
+    if (parse_hex(field, &hex_data) != 0)
+        return 1;
+    if ((arch & CPU_TYPE_X86_64) == CPU_TYPE_X86_64)
+        copy_data(&entry->x86_64_p, &hex_data);
+    if ((arch & CPU_TYPE_ARM64) == CPU_TYPE_ARM64)
+        copy_data(&entry->arm64_p, &hex_data);
+    free(hex_data.buf);
+    return 0;
+}
+
+static char *resolve_path(const char *manifest_path, const char *file) {
+    const char *slash = strrchr(manifest_path, '/');
+    if (file[0] == '/' || slash == NULL)
+        return strdup(file);
+    size_t dir_len = slash - manifest_path + 1;
+    char *path = malloc(dir_len + strlen(file) + 1);
+    memcpy(path, manifest_path, dir_len);
+    strcpy(path + dir_len, file);
+    return path;
+}
+
+manifest_t *load_manifest(const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        perror("fopen");
+        return NULL;
+    }
+    manifest_t *manifest = calloc(1, sizeof(manifest_t));
+    int cap = 0;
+    int lineno = 0;
+    char line[4096];
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        lineno++;
+        line[strcspn(line, "\n")] = '\0';
+        char *fields[MAX_FIELDS];
+        int nfields = split_fields(line, fields);
+        if (nfields == 0)
+            continue;
+        if (nfields < 0) {
+            fprintf(stderr, "symp: %s:%d: too many fields or unterminated quote\n", path, lineno);
+            goto err;
+        }
+        if (nfields < 3) {
+            fprintf(stderr, "symp: %s:%d: expected <file> <symbol> <patch>...\n", path, lineno);
+            goto err;
+        }
+        if (manifest->nentries == cap) {
+            cap = cap ? cap * 2 : 16;
+            manifest->entries = realloc(manifest->entries, cap * sizeof(manifest_entry_t));
+        }
+        manifest_entry_t *entry = &manifest->entries[manifest->nentries++];
+        memset(entry, 0, sizeof(manifest_entry_t));
+        entry->file = resolve_path(path, fields[0]);
+        entry->symbol = strdup(fields[1]);
+        for (int i = 2; i < nfields; i++) {
+            if (parse_patch(fields[i], entry) != 0) {
+                fprintf(stderr, "symp: %s:%d: invalid patch '%s'\n", path, lineno, fields[i]);
+                goto err;
+            }
+        }
+    }
+    fclose(fp);
+    if (manifest->nentries == 0) {
+        fprintf(stderr, "symp: %s: no patch found\n", path);
+        free_manifest(manifest);
+        return NULL;
+    }
+    return manifest;
+
+err:
+    fclose(fp);
+    free_manifest(manifest);
+    return NULL;
+}
+
+void free_manifest(manifest_t *manifest) {
+    for (int i = 0; i < manifest->nentries; i++) {
+        free(manifest->entries[i].file);
+        free(manifest->entries[i].symbol);
+        free(manifest->entries[i].x86_64_p.buf);
+        free(manifest->entries[i].arm64_p.buf);
+        free(manifest->entries[i].x86_64_e.buf);
+        free(manifest->entries[i].arm64_e.buf);
+    }
+    free(manifest->entries);
+    free(manifest);
+}
+
+const data_t *manifest_patch(const manifest_entry_t *entry, int32_t cputype) {
+    const data_t *patch = NULL;
+    if (cputype == CPU_TYPE_X86_64)
+        patch = &entry->x86_64_p;
+    else if (cputype == CPU_TYPE_ARM64)
+        patch = &entry->arm64_p;
+    if (patch == NULL || patch->buf == NULL)
+        return NULL;
+    return patch;
+}
+
+const data_t *manifest_expect(const manifest_entry_t *entry, int32_t cputype) {
+    const data_t *expect = NULL;
+    if (cputype == CPU_TYPE_X86_64)
+        expect = &entry->x86_64_e;
+    else if (cputype == CPU_TYPE_ARM64)
+        expect = &entry->arm64_e;
+    if (expect == NULL || expect->buf == NULL)
+        return NULL;
+    return expect;
+}
@@ -0,0 +1,120 @@
+#include "private.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+typedef struct {
+    patch_site_t *site;
+    size_t len;         /* max of patch and expect length */
+    uint8_t *current;   /* bytes in the file now */
+} site_read_t;
+
+static int cmp_read_off(const void *a, const void *b) {
+    const site_read_t *ra = a, *rb = b;
+    if (ra->site->poff.fileoff != rb->site->poff.fileoff)
+        return ra->site->poff.fileoff < rb->site->poff.fileoff ? -1 : 1;
+    return 0;
+}
+
+int patch_file(FILE *fp, const char *path, patch_site_t *sites, int nsites) {
+    int nerrors = 0;
+    int nreads = 0;
+    site_read_t *reads = malloc(nsites * sizeof(site_read_t));
+    for (int i = 0; i < nsites; i++) {
+        patch_site_t *site = &sites[i];
+        site->status = PATCH_ERROR;
+        if (site->poff.maxplen != 0 && site->patch->len > site->poff.maxplen) {
+            fprintf(stderr, "symp: patch length(%zu) exceeded! (max %u)\n", site->patch->len, site->poff.maxplen);
+            nerrors++;
+            continue;
+        }
+        size_t len = site->patch->len;
+        if (site->expect != NULL && site->expect->len > len)
+            len = site->expect->len;
+        reads[nreads].site = site;
+        reads[nreads].len = len;
+        nreads++;
+    }
+
+    /*
+     * overlapping sites would each record the bytes before the batch in the undo log,
+     * which can not be reverted in any order, keep only the last one of the sites
+     */
+    qsort(reads, nreads, sizeof(site_read_t), cmp_read_off);
+    int nkept = 0;
+    size_t total_len = 0;
+    for (int i = 0, next = 0; i < nreads; i = next) {
+        long end = reads[i].site->poff.fileoff + (long)reads[i].site->patch->len;
+        int last = i;
+        for (next = i + 1; next < nreads && reads[next].site->poff.fileoff < end; next++) {
+            const patch_site_t *site = reads[next].site;
+            if (site->poff.fileoff + (long)site->patch->len > end)
+                end = site->poff.fileoff + (long)site->patch->len;
+            if (site > reads[last].site)
+                last = next;
+        }
+        for (int j = i; j < next; j++) {
+            if (j != last) {
+                fprintf(stderr, "symp: patch at 0x%lx overlaps another one, skipped\n", reads[j].site->poff.fileoff);
+                nerrors++;
+            }
+        }
+        total_len += reads[last].len;
+        reads[nkept++] = reads[last];
+    }
+    nreads = nkept;
+
+    /* read the current bytes of all sites first, in file order */
+    uint8_t *buf = malloc(total_len ? total_len : 1);
+    uint8_t *cur_pos = buf;
+    for (int i = 0; i < nreads; i++) {
+        reads[i].current = cur_pos;
+        cur_pos += reads[i].len;
+        if (fseek(fp, reads[i].site->poff.fileoff, SEEK_SET) != 0 ||
+            (reads[i].len != 0 && fread(reads[i].current, reads[i].len, 1, fp) != 1)) {
+            fprintf(stderr, "symp: can not read the bytes at 0x%lx\n", reads[i].site->poff.fileoff);
+            reads[i].site = NULL;
+            nerrors++;
+        }
+    }
+
+    /* then write only the sites that differ, once their original bytes are in the undo log */
+    int nwrites = 0;
+    patch_site_t **writes = malloc((nreads ? nreads : 1) * sizeof(patch_site_t *));
+    const uint8_t **originals = malloc((nreads ? nreads : 1) * sizeof(uint8_t *));
+    for (int i = 0; i < nreads; i++) {
+        patch_site_t *site = reads[i].site;
+        if (site == NULL)
+            continue;
+        if (memcmp(reads[i].current, site->patch->buf, site->patch->len) == 0) {
+            site->status = PATCH_ALREADY;
+            continue;
+        }
+        if (site->expect != NULL && memcmp(reads[i].current, site->expect->buf, site->expect->len) != 0) {
+            fprintf(stderr, "symp: bytes at 0x%lx do not match the expected ones\n", site->poff.fileoff);
+            nerrors++;
+            continue;
+        }
+        writes[nwrites] = site;
+        originals[nwrites++] = reads[i].current;
+    }
+    if (record_undo(path, writes, originals, nwrites) != 0) {
+        nerrors += nwrites; /* they could never be reverted */
+        nwrites = 0;
+    }
+    for (int i = 0; i < nwrites; i++) {
+        patch_site_t *site = writes[i];
+        if (fseek(fp, site->poff.fileoff, SEEK_SET) != 0 || fwrite(site->patch->buf, site->patch->len, 1, fp) != 1) {
+            perror("fwrite");
+            nerrors++;
+            continue;
+        }
+        site->status = PATCH_WRITTEN;
+    }
+    free(writes);
+    free(originals);
+    free(buf);
+    free(reads);
+    return nerrors;
+}
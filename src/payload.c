@@ -0,0 +1,278 @@
+#include "private.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <mach-o/loader.h>
+
+/*
+ * payload language, statements separated by ';':
+ *   ret [<imm>]    return, with imm in the return register if offered
+ *   mov <imm>      load imm into the return register (x0 / rax)
+ *   b <target>     branch to a symbol or an address (0x...)
+ *   nop <len>      pad the payload with nops up to len bytes
+ * immediates are decimal or 0x hex, and may be negative
+ * only nops may follow ret and b
+ */
+
+#define ARM64_RET  0xD65F03C0
+#define ARM64_NOP  0xD503201F
+#define ARM64_B    0x14000000
+#define ARM64_MOVZ 0xD2800000  /* x0 */
+#define ARM64_MOVN 0x92800000
+#define ARM64_MOVK 0xF2800000
+
+/* longest encoding of a statement, movabs or 4 movs */
+#define MAX_INSN_LEN 16
+#define MAX_SLED_LEN (1 << 20)
+
+static char *trim(char *str) {
+    while (isspace((unsigned char)*str))
+        str++;
+    char *end = str + strlen(str);
+    while (end > str && isspace((unsigned char)end[-1]))
+        end--;
+    *end = '\0';
+    return str;
+}
+
+static int parse_imm(const char *str, uint64_t *imm) {
+    char *end;
+    errno = 0;
+    if (str[0] == '-')
+        *imm = (uint64_t)strtoll(str, &end, 0);
+    else
+        *imm = strtoull(str, &end, 0);
+    if (errno != 0 || end == str || *end != '\0') {
+        fprintf(stderr, "symp: invalid immediate '%s'\n", str);
+        return 1;
+    }
+    return 0;
+}
+
+static payload_insn_t *add_insn(payload_t *payload, payload_op_t op, uint64_t imm) {
+    if (payload->ninsns == MAX_PAYLOAD_INSNS) {
+        fprintf(stderr, "symp: too many statements in patch (max %d)\n", MAX_PAYLOAD_INSNS);
+        return NULL;
+    }
+    payload_insn_t *insn = &payload->insns[payload->ninsns++];
+    insn->op = op;
+    insn->imm = imm;
+    return insn;
+}
+
+payload_t *parse_payload(const char *src) {
+    payload_t *payload = calloc(1, sizeof(payload_t));
+    char *copy = strdup(src);
+    bool terminated = false;
+    char *saveptr = NULL;
+    for (char *stmt = strtok_r(copy, ";", &saveptr); stmt != NULL; stmt = strtok_r(NULL, ";", &saveptr)) {
+        stmt = trim(stmt);
+        if (*stmt == '\0')
+            continue;
+        char *operand = stmt + strcspn(stmt, " \t");
+        if (*operand != '\0')
+            *operand++ = '\0';
+        operand = trim(operand);
+
+        uint64_t imm = 0;
+        if (strcmp(stmt, "nop") == 0) {
+            if (parse_imm(operand, &imm) != 0 || add_insn(payload, PAYLOAD_NOP, imm) == NULL)
+                goto err;
+            continue;
+        }
+        if (terminated) {
+            fprintf(stderr, "symp: only nops may follow ret and b in patch '%s'\n", src);
+            goto err;
+        }
+        if (strcmp(stmt, "ret") == 0) {
+            if (*operand != '\0' && (parse_imm(operand, &imm) != 0 || add_insn(payload, PAYLOAD_MOV, imm) == NULL))
+                goto err;
+            if (add_insn(payload, PAYLOAD_RET, 0) == NULL)
+                goto err;
+            terminated = true;
+        }
+        else if (strcmp(stmt, "mov") == 0) {
+            if (parse_imm(operand, &imm) != 0 || add_insn(payload, PAYLOAD_MOV, imm) == NULL)
+                goto err;
+        }
+        else if (strcmp(stmt, "b") == 0) {
+            if (*operand == '\0') {
+                fprintf(stderr, "symp: b needs a symbol or an address\n");
+                goto err;
+            }
+            if (add_insn(payload, PAYLOAD_BRANCH, 0) == NULL)
+                goto err;
+            payload->target = strdup(operand);
+            terminated = true;
+        }
+        else {
+            fprintf(stderr, "symp: unknown statement '%s' in patch\n", stmt);
+            goto err;
+        }
+    }
+    free(copy);
+    if (payload->ninsns == 0) {
+        fprintf(stderr, "symp: empty patch '%s'\n", src);
+        free_payload(payload);
+        return NULL;
+    }
+    return payload;
+
+err:
+    free(copy);
+    free_payload(payload);
+    return NULL;
+}
+
+void free_payload(payload_t *payload) {
+    if (payload == NULL)
+        return;
+    free(payload->target);
+    free(payload);
+}
+
+static size_t put_u32(uint8_t *out, uint32_t value) {
+    for (int i = 0; i < 4; i++)
+        out[i] = value >> (i * 8);
+    return 4;
+}
+
+/* movz/movn then movk for the remaining halfwords, whichever is shorter */
+static size_t arm64_mov_x0(uint8_t *out, uint64_t imm) {
+    int nzero = 0, nones = 0;
+    for (int hw = 0; hw < 4; hw++) {
+        uint16_t half = imm >> (hw * 16);
+        nzero += half == 0;
+        nones += half == 0xFFFF;
+    }
+    const bool inverted = nones > nzero;
+    const uint16_t skipped = inverted ? 0xFFFF : 0;
+    size_t len = 0;
+    for (int hw = 0; hw < 4; hw++) {
+        uint16_t half = imm >> (hw * 16);
+        if (half == skipped)
+            continue;
+        if (len == 0)
+            len += put_u32(out, (inverted ? ARM64_MOVN : ARM64_MOVZ) | hw << 21 | (uint16_t)(inverted ? ~half : half) << 5);
+        else
+            len += put_u32(out + len, ARM64_MOVK | hw << 21 | half << 5);
+    }
+    if (len == 0) /* all halfwords skipped, 0 or -1 */
+        len = put_u32(out, inverted ? ARM64_MOVN : ARM64_MOVZ);
+    return len;
+}
+
+static size_t x86_64_mov_rax(uint8_t *out, uint64_t imm) {
+    if (imm == 0) { /* xor eax, eax */
+        out[0] = 0x31, out[1] = 0xC0;
+        return 2;
+    }
+    if (imm <= UINT32_MAX) { /* mov eax, imm32, zero-extended */
+        out[0] = 0xB8;
+        return 1 + put_u32(out + 1, imm);
+    }
+    if ((int64_t)imm >= INT32_MIN && (int64_t)imm <= INT32_MAX) { /* mov rax, simm32 */
+        out[0] = 0x48, out[1] = 0xC7, out[2] = 0xC0;
+        return 3 + put_u32(out + 3, imm);
+    }
+    out[0] = 0x48, out[1] = 0xB8; /* movabs rax, imm64 */
+    put_u32(out + 2, imm);
+    put_u32(out + 6, imm >> 32);
+    return 10;
+}
+
+static int encode_branch(int32_t cputype, uint8_t *out, size_t *len, uint64_t pc, uint64_t target) {
+    const int64_t disp = target - pc;
+    if (cputype == CPU_TYPE_ARM64) {
+        if (disp % 4 != 0 || disp < -(1LL << 27) || disp >= (1LL << 27)) {
+            fprintf(stderr, "symp: branch target 0x%llx out of range of b at 0x%llx\n",
+                    (unsigned long long)target, (unsigned long long)pc);
+            return 1;
+        }
+        *len = put_u32(out, ARM64_B | ((uint64_t)(disp >> 2) & 0x3FFFFFF));
+        return 0;
+    }
+    /* jmp rel8 if it fits, rel32 otherwise, relative to the next instruction */
+    if (disp - 2 >= INT8_MIN && disp - 2 <= INT8_MAX) {
+        out[0] = 0xEB, out[1] = (uint8_t)(disp - 2);
+        *len = 2;
+        return 0;
+    }
+    if (disp - 5 < INT32_MIN || disp - 5 > INT32_MAX) {
+        fprintf(stderr, "symp: branch target 0x%llx out of range of jmp at 0x%llx\n",
+                (unsigned long long)target, (unsigned long long)pc);
+        return 1;
+    }
+    out[0] = 0xE9;
+    *len = 1 + put_u32(out + 1, (uint32_t)(disp - 5));
+    return 0;
+}
+
+int compile_payload(const payload_t *payload, int32_t cputype, uint64_t vmaddr, uint64_t target, data_t *out) {
+    if (cputype != CPU_TYPE_ARM64 && cputype != CPU_TYPE_X86_64) {
+        char *arch = arch2str(cputype);
+        fprintf(stderr, "symp: can not compile patch for arch '%s'\n", arch ? arch : "unknown");
+        return 1;
+    }
+    const size_t insn_align = cputype == CPU_TYPE_ARM64 ? 4 : 1;
+    /* nops pad up to the longest sled, everything else fits in MAX_INSN_LEN */
+    uint64_t max_sled = 0;
+    for (int i = 0; i < payload->ninsns; i++) {
+        if (payload->insns[i].op == PAYLOAD_NOP && payload->insns[i].imm > max_sled)
+            max_sled = payload->insns[i].imm;
+    }
+    if (max_sled > MAX_SLED_LEN) {
+        fprintf(stderr, "symp: nop sled too long (max %d)\n", MAX_SLED_LEN);
+        return 1;
+    }
+    size_t cap = max_sled + (size_t)payload->ninsns * MAX_INSN_LEN;
+    uint8_t *buf = malloc(cap);
+    size_t len = 0;
+    for (int i = 0; i < payload->ninsns; i++) {
+        const payload_insn_t *insn = &payload->insns[i];
+        size_t insn_len = 0;
+        switch (insn->op) {
+        case PAYLOAD_RET:
+            if (cputype == CPU_TYPE_ARM64)
+                insn_len = put_u32(buf + len, ARM64_RET);
+            else
+                buf[len] = 0xC3, insn_len = 1;
+            break;
+        case PAYLOAD_MOV:
+            if (cputype == CPU_TYPE_ARM64)
+                insn_len = arm64_mov_x0(buf + len, insn->imm);
+            else
+                insn_len = x86_64_mov_rax(buf + len, insn->imm);
+            break;
+        case PAYLOAD_BRANCH:
+            if (encode_branch(cputype, buf + len, &insn_len, vmaddr + len, target) != 0)
+                goto err;
+            break;
+        case PAYLOAD_NOP:
+            if (insn->imm < len || insn->imm % insn_align != 0) {
+                fprintf(stderr, "symp: can not pad a %zu bytes patch to %llu bytes with nops\n",
+                        len, (unsigned long long)insn->imm);
+                goto err;
+            }
+            /* a sled of single nops, so any of them is a valid entry */
+            for (; len < insn->imm; len += insn_align) {
+                if (cputype == CPU_TYPE_ARM64)
+                    put_u32(buf + len, ARM64_NOP);
+                else
+                    buf[len] = 0x90;
+            }
+            break;
+        }
+        len += insn_len;
+    }
+    out->len = len;
+    out->buf = buf;
+    return 0;
+
+err:
+    free(buf);
+    return 1;
+}
@@ -0,0 +1,333 @@
+#include "private.h"
+#include "fileio.h"
+
+#include <errno.h>
+#include <string.h>
+#include <limits.h>
+#include <stdlib.h>
+
+/*
+ * a manifest compiled into a binary plan, kept in the cache directory:
+ *   plan_header_t
+ *   for each file: plan_file_t, its path (NUL padded to 8 bytes),
+ *     for each slice: plan_slice_t, then plan_site_t[nsites]
+ * sites are grouped by file and slice, so each file is opened once and
+ * the symbols of a slice are resolved at once
+ * a slice is resolved again only if the manifest or its LC_UUID changed
+ */
+
+#define PLAN_MAGIC 0x314e414c50504d53ULL /* "SMPPLAN1" */
+#define PLAN_NOT_FOUND 0xFFFFFFFF /* source of a site whose symbol is missing */
+
+typedef struct {
+    uint64_t magic;
+    uint64_t manifest_hash;
+    uint32_t nfiles;
+    uint32_t reserved;
+} plan_header_t;
+
+typedef struct {
+    uint32_t path_size;  /* padded */
+    uint32_t nslices;
+} plan_file_t;
+
+typedef struct {
+    int64_t offset;
+    int32_t cputype;
+    uint32_t nsites;
+    uint8_t uuid[16];
+} plan_slice_t;
+
+typedef struct {
+    uint32_t entry;   /* index in the manifest */
+    uint32_t maxplen;
+    uint32_t source;  /* symsrc_t, or PLAN_NOT_FOUND */
+    uint32_t reserved;
+    int64_t fileoff;
+    uint64_t vmaddr;
+} plan_site_t;
+
+/* plan being written */
+typedef struct {
+    size_t len, cap;
+    uint8_t *buf;
+} plan_buf_t;
+
+static void *plan_append(plan_buf_t *plan, size_t len) {
+    if (plan->cap - plan->len < len) {
+        while (plan->cap - plan->len < len)
+            plan->cap = plan->cap ? plan->cap * 2 : 4096;
+        plan->buf = realloc(plan->buf, plan->cap);
+    }
+    void *out = plan->buf + plan->len;
+    memset(out, 0, len);
+    plan->len += len;
+    return out;
+}
+
+/* the cache path of the plan of a manifest, by the hash of its full path */
+static char *plan_cache_path(const char *manifest_path) {
+    char full_path[PATH_MAX];
+    if (realpath(manifest_path, full_path) == NULL)
+        return NULL;
+    char name[64];
+    snprintf(name, sizeof(name), "plan-%016llx.plan",
+             (unsigned long long)hash_update(HASH_INIT, full_path));
+    return cache_file_path(name);
+}
+
+/* return NULL if missing, corrupted, or compiled from another manifest */
+static uint8_t *read_plan(const char *path, uint64_t manifest_hash, size_t *size) {
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+        return NULL;
+    uint8_t *plan = NULL;
+    plan_header_t header;
+    fseek(fp, 0, SEEK_END);
+    long len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if (len >= (long)sizeof(header) && fread(&header, sizeof(header), 1, fp) == 1 &&
+        header.magic == PLAN_MAGIC && header.manifest_hash == manifest_hash) {
+        fseek(fp, 0, SEEK_SET);
+        plan = read_file(fp, len);
+        *size = len;
+    }
+    fclose(fp);
+    return plan;
+}
+
+/* the cached slices of path, NULL if not in the plan */
+static const plan_file_t *find_plan_file(const uint8_t *plan, size_t size, const char *path) {
+    if (plan == NULL)
+        return NULL;
+    const plan_header_t *header = (const void *)plan;
+    const uint8_t *cur_pos = plan + sizeof(plan_header_t), *end = plan + size;
+    for (uint32_t i = 0; i < header->nfiles; i++) {
+        const plan_file_t *file = (const void *)cur_pos;
+        if (end - cur_pos < sizeof(plan_file_t) || file->path_size > end - cur_pos - sizeof(plan_file_t))
+            return NULL;
+        const char *file_path = (const char *)(file + 1);
+        cur_pos += sizeof(plan_file_t) + file->path_size;
+        if (file->path_size == 0 || file_path[file->path_size - 1] != '\0')
+            return NULL;
+        /* check the slices, whether it is the one or not */
+        for (uint32_t j = 0; j < file->nslices; j++) {
+            const plan_slice_t *slice = (const void *)cur_pos;
+            if (end - cur_pos < sizeof(plan_slice_t) ||
+                slice->nsites > (end - cur_pos - sizeof(plan_slice_t)) / sizeof(plan_site_t))
+                return NULL;
+            cur_pos += sizeof(plan_slice_t) + slice->nsites * sizeof(plan_site_t);
+        }
+        if (strcmp(file_path, path) == 0)
+            return file;
+    }
+    return NULL;
+}
+
+/* the cached slice at offset if the same image, its sites follow it */
+static const plan_slice_t *find_plan_slice(const plan_file_t *file, const slice_id_t *slice, int max_sites) {
+    static const uint8_t zero_uuid[16] = {0};
+    if (file == NULL || memcmp(slice->uuid, zero_uuid, sizeof(zero_uuid)) == 0)
+        return NULL; /* no way to tell if it changed */
+    const uint8_t *cur_pos = (const uint8_t *)(file + 1) + file->path_size;
+    for (uint32_t i = 0; i < file->nslices; i++) {
+        const plan_slice_t *cached = (const void *)cur_pos;
+        if (cached->offset == slice->offset && cached->cputype == slice->cputype && cached->nsites <= max_sites &&
+            memcmp(cached->uuid, slice->uuid, sizeof(slice->uuid)) == 0)
+            return cached;
+        cur_pos += sizeof(plan_slice_t) + cached->nsites * sizeof(plan_site_t);
+    }
+    return NULL;
+}
+
+/* resolve the entries of path with a patch for the slice, append the sites to the plan */
+static void compile_slice(FILE *fp, const manifest_t *manifest, const char *path,
+                          const slice_id_t *slice, plan_buf_t *plan) {
+    const size_t slice_pos = plan->len;
+    plan_slice_t *planned = plan_append(plan, sizeof(plan_slice_t));
+    planned->offset = slice->offset;
+    planned->cputype = slice->cputype;
+    memcpy(planned->uuid, slice->uuid, sizeof(planned->uuid));
+
+    int nsymbols = 0;
+    int *entries = malloc(manifest->nentries * sizeof(int));
+    char **symbol_names = malloc(manifest->nentries * sizeof(char *));
+    for (int i = 0; i < manifest->nentries; i++) {
+        const manifest_entry_t *entry = &manifest->entries[i];
+        if (strcmp(entry->file, path) != 0 || manifest_patch(entry, slice->cputype) == NULL)
+            continue;
+        entries[nsymbols] = i;
+        symbol_names[nsymbols++] = entry->symbol;
+    }
+    patch_off_t *poffs = malloc((nsymbols ? nsymbols : 1) * sizeof(patch_off_t));
+    bool *found = malloc((nsymbols ? nsymbols : 1) * sizeof(bool));
+    fseek(fp, slice->offset, SEEK_SET);
+    lookup_symbols_macho(fp, symbol_names, nsymbols, poffs, found);
+
+    plan_site_t *sites = plan_append(plan, nsymbols * sizeof(plan_site_t));
+    for (int i = 0; i < nsymbols; i++) {
+        sites[i].entry = entries[i];
+        sites[i].source = PLAN_NOT_FOUND;
+        if (!found[i])
+            continue;
+        sites[i].maxplen = poffs[i].maxplen;
+        sites[i].source = poffs[i].source;
+        sites[i].fileoff = poffs[i].fileoff;
+        sites[i].vmaddr = poffs[i].vmaddr;
+    }
+    ((plan_slice_t *)(plan->buf + slice_pos))->nsites = nsymbols;
+    free(entries);
+    free(symbol_names);
+    free(poffs);
+    free(found);
+}
+
+/* add the sites of a planned slice, return the number of failed ones */
+static int add_sites(const manifest_t *manifest, const char *path, const plan_slice_t *slice,
+                     const uint8_t *uuid, patch_site_t *sites, int *nsites) {
+    int nerrors = 0;
+    const plan_site_t *planned = (const void *)(slice + 1);
+    for (uint32_t i = 0; i < slice->nsites; i++) {
+        if (planned[i].entry >= manifest->nentries || manifest_patch(&manifest->entries[planned[i].entry], slice->cputype) == NULL)
+            continue; /* same hash, another manifest */
+        const manifest_entry_t *entry = &manifest->entries[planned[i].entry];
+        if (planned[i].source == PLAN_NOT_FOUND) {
+            char *arch = arch2str(slice->cputype);
+            fprintf(stderr, "symp: %s: symbol '%s' not found for arch '%s'!\n",
+                    path, entry->symbol, arch ? arch : "unknown");
+            nerrors++;
+            continue;
+        }
+        patch_site_t *site = &sites[(*nsites)++];
+        site->poff.cputype = slice->cputype;
+        site->poff.maxplen = planned[i].maxplen;
+        site->poff.fileoff = planned[i].fileoff;
+        site->poff.vmaddr = planned[i].vmaddr;
+        site->poff.source = planned[i].source;
+        site->poff.path = NULL;
+        site->patch = manifest_patch(entry, slice->cputype);
+        site->expect = manifest_expect(entry, slice->cputype);
+        site->uuid = uuid;
+    }
+    return nerrors;
+}
+
+/* patch path with the cached plan of its slices or a new one, return the number of errors */
+static int apply_file(const manifest_t *manifest, const char *path, const plan_file_t *cached,
+                      plan_buf_t *plan, bool *changed) {
+    const size_t file_pos = plan->len;
+    const size_t path_size = PAD8(strlen(path) + 1);
+    plan_append(plan, sizeof(plan_file_t));
+    memcpy(plan_append(plan, path_size), path, strlen(path));
+    /* set before any early return, the next files are found by skipping this path */
+    ((plan_file_t *)(plan->buf + file_pos))->path_size = path_size;
+
+    FILE *fp = fopen(path, "rb+");
+    if (fp == NULL) {
+        fprintf(stderr, "symp: can not open %s: %s\n", path, strerror(errno));
+        *changed = true; /* nothing planned for it */
+        return 1;
+    }
+    slice_scan_t scan;
+    if (scan_slices(fp, &scan) < 0) {
+        fprintf(stderr, "symp: %s: not a valid Mach-O or FAT file\n", path);
+        fclose(fp);
+        *changed = true;
+        return 1;
+    }
+
+    int nerrors = 0;
+    int nsites = 0;
+    patch_site_t *sites = malloc((manifest->nentries * scan.nslices + 1) * sizeof(patch_site_t));
+    for (int i = 0; i < scan.nslices; i++) {
+        const slice_id_t *slice = &scan.slices[i];
+        if (o_patch_arch != 0 && (slice->cputype & o_patch_arch) != slice->cputype)
+            continue;
+        const size_t slice_pos = plan->len;
+        const plan_slice_t *planned = find_plan_slice(cached, slice, manifest->nentries);
+        if (planned != NULL)
+            memcpy(plan_append(plan, sizeof(plan_slice_t) + planned->nsites * sizeof(plan_site_t)),
+                   planned, sizeof(plan_slice_t) + planned->nsites * sizeof(plan_site_t));
+        else {
+            compile_slice(fp, manifest, path, slice, plan);
+            *changed = true;
+        }
+        ((plan_file_t *)(plan->buf + file_pos))->nslices++;
+        nerrors += add_sites(manifest, path, (const void *)(plan->buf + slice_pos), slice->uuid, sites, &nsites);
+    }
+    nerrors += patch_file(fp, path, sites, nsites);
+    fclose(fp);
+
+    int npatched = 0, nalready = 0;
+    for (int i = 0; i < nsites; i++) {
+        if (sites[i].status == PATCH_WRITTEN)
+            npatched++;
+        else if (sites[i].status == PATCH_ALREADY)
+            nalready++;
+    }
+    free(sites);
+    if (!o_quiet) {
+        printf("%s: %d(%d) matches patched", path, npatched, nsites);
+        if (nalready != 0)
+            printf(", %d already-patched", nalready);
+        printf("\n");
+    }
+    return nerrors;
+}
+
+int apply_manifest(const char *path) {
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        perror("fopen");
+        return 1;
+    }
+    fseek(fp, 0, SEEK_END);
+    long len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    uint8_t *contents = len > 0 ? read_file(fp, len) : NULL;
+    fclose(fp);
+    const uint64_t manifest_hash = hash_bytes(HASH_INIT, contents, contents ? len : 0);
+    free(contents);
+
+    manifest_t *manifest = load_manifest(path);
+    if (manifest == NULL)
+        return 1;
+
+    char *cache_path = plan_cache_path(path);
+    size_t cached_size = 0;
+    uint8_t *cached = cache_path != NULL ? read_plan(cache_path, manifest_hash, &cached_size) : NULL;
+    /* rewritten when a file is planned differently, e.g. with another -a */
+    bool changed = cached == NULL;
+
+    plan_buf_t plan = {0};
+    plan_header_t *header = plan_append(&plan, sizeof(plan_header_t));
+    header->magic = PLAN_MAGIC;
+    header->manifest_hash = manifest_hash;
+    uint32_t nfiles = 0;
+    int nerrors = 0;
+    for (int i = 0; i < manifest->nentries; i++) {
+        const char *file_path = manifest->entries[i].file;
+        int j = 0;
+        while (j < i && strcmp(manifest->entries[j].file, file_path) != 0)
+            j++;
+        if (j < i)
+            continue; /* one pass for each distinct path */
+        const plan_file_t *cached_file = find_plan_file(cached, cached_size, file_path);
+        const size_t file_pos = plan.len;
+        nerrors += apply_file(manifest, file_path, cached_file, &plan, &changed);
+        nfiles++;
+        if (cached_file == NULL ||
+            memcmp(cached_file, plan.buf + file_pos, sizeof(plan_file_t)) != 0)
+            changed = true;
+    }
+    ((plan_header_t *)plan.buf)->nfiles = nfiles;
+
+    if (changed && cache_path != NULL)
+        write_file_atomic(cache_path, plan.buf, plan.len); /* the plan is optional */
+    free(plan.buf);
+    free(cached);
+    free(cache_path);
+    free_manifest(manifest);
+    release_lookup_state();
+    return nerrors != 0;
+}
@@ -0,0 +1,193 @@
+#include "private.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <mach-o/fat.h>
+#include <mach-o/nlist.h>
+#include <mach-o/loader.h>
+
+/*
+ * a pool of threads reading ahead the files of a scan with pread:
+ * header and load commands first, then the __LINKEDIT tables they point to,
+ * so the resolvers find them in the page cache and reads of many files are in flight at once
+ */
+
+#define PREFETCH_THREADS 8
+#define PREFETCH_WINDOW 64          /* files read ahead of the consumer at most */
+#define PREFETCH_CHUNK (1 << 20)    /* bytes of a single read */
+#define MAX_CMDS_SIZE (1 << 20)
+
+struct prefetcher {
+    char **paths;
+    int npaths;
+    prefetch_filter_t need_tables;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int next;       /* next path to read ahead */
+    int consumed;   /* the consumer waits for this one */
+    bool *done;
+    bool stopping;
+
+    int nthreads;
+    pthread_t threads[PREFETCH_THREADS];
+};
+
+typedef struct {
+    uint64_t off, size;
+} file_range_t;
+
+static void read_range(int fd, long base, uint64_t off, uint64_t size, uint8_t *scratch) {
+    for (uint64_t done = 0; done < size; ) {
+        size_t len = size - done < PREFETCH_CHUNK ? size - done : PREFETCH_CHUNK;
+        ssize_t ret = pread(fd, scratch, len, base + off + done);
+        if (ret <= 0)
+            return; /* the resolvers report errors */
+        done += ret;
+    }
+}
+
+static void prefetch_slice(const struct prefetcher *pf, int fd, long base, uint8_t *scratch) {
+    struct mach_header_64 header;
+    if (pread(fd, &header, sizeof(header), base) != sizeof(header) ||
+        header.magic != MH_MAGIC_64 || header.sizeofcmds > MAX_CMDS_SIZE)
+        return;
+    if (pread(fd, scratch, header.sizeofcmds, base + sizeof(header)) != header.sizeofcmds)
+        return;
+
+    /* the tables a lookup reads, offsets are relative to the slice */
+    file_range_t ranges[16];
+    int nranges = 0;
+    uint8_t uuid[16] = {0};
+    const uint8_t *cur_pos = scratch, *end = scratch + header.sizeofcmds;
+    for (int i = 0; i < header.ncmds && end - cur_pos >= sizeof(struct load_command); i++) {
+        const struct load_command *command = (const void *)cur_pos;
+        if (command->cmdsize < sizeof(struct load_command) || command->cmdsize > end - cur_pos)
+            break;
+        switch (command->cmd) {
+        case LC_SYMTAB: {
+            const struct symtab_command *symtab = (const void *)command;
+            ranges[nranges++] = (file_range_t){symtab->symoff, (uint64_t)symtab->nsyms * sizeof(struct nlist_64)};
+            ranges[nranges++] = (file_range_t){symtab->stroff, symtab->strsize};
+            break;
+        }
+        case LC_DYSYMTAB: {
+            const struct dysymtab_command *dysymtab = (const void *)command;
+            ranges[nranges++] = (file_range_t){dysymtab->indirectsymoff, (uint64_t)dysymtab->nindirectsyms * sizeof(uint32_t)};
+            break;
+        }
+        case LC_DYLD_INFO:
+        case LC_DYLD_INFO_ONLY: {
+            const struct dyld_info_command *dyld_info = (const void *)command;
+            ranges[nranges++] = (file_range_t){dyld_info->export_off, dyld_info->export_size};
+            break;
+        }
+        case LC_DYLD_EXPORTS_TRIE:
+        case LC_FUNCTION_STARTS: {
+            const struct linkedit_data_command *linkedit = (const void *)command;
+            ranges[nranges++] = (file_range_t){linkedit->dataoff, linkedit->datasize};
+            break;
+        }
+        case LC_UUID:
+            memcpy(uuid, ((const struct uuid_command *)command)->uuid, sizeof(uuid));
+            break;
+        }
+        if (nranges > ARRAY_LEN(ranges) - 2)
+            break;
+        cur_pos += command->cmdsize;
+    }
+
+    if (pf->need_tables != NULL && !pf->need_tables(uuid, header.cputype))
+        return;
+    for (int i = 0; i < nranges; i++) {
+        if (ranges[i].off != 0)
+            read_range(fd, base, ranges[i].off, ranges[i].size, scratch);
+    }
+}
+
+static void prefetch_file(const struct prefetcher *pf, const char *path, uint8_t *scratch) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return;
+    uint32_t head[2 + MAX_FAT_ARCHS * sizeof(struct fat_arch) / sizeof(uint32_t)];
+    ssize_t len = pread(fd, head, sizeof(head), 0);
+    if (len >= sizeof(uint32_t) * 2 && head[0] == MH_MAGIC_64)
+        prefetch_slice(pf, fd, 0, scratch);
+    else if (len >= sizeof(uint32_t) * 2 && head[0] == FAT_CIGAM) {
+        uint32_t nfat_arch = OSSwapInt32(head[1]);
+        const struct fat_arch *archs = (const void *)(head + 2);
+        for (int i = 0; i < nfat_arch && i < MAX_FAT_ARCHS; i++) {
+            if ((const uint8_t *)(archs + i + 1) > (const uint8_t *)head + len)
+                break;
+            prefetch_slice(pf, fd, OSSwapInt32(archs[i].offset), scratch);
+        }
+    }
+    close(fd);
+}
+
+static void *prefetch_worker(void *arg) {
+    struct prefetcher *pf = arg;
+    uint8_t *scratch = malloc(PREFETCH_CHUNK > MAX_CMDS_SIZE ? PREFETCH_CHUNK : MAX_CMDS_SIZE);
+    pthread_mutex_lock(&pf->lock);
+    while (1) {
+        while (!pf->stopping && pf->next < pf->npaths && pf->next >= pf->consumed + PREFETCH_WINDOW)
+            pthread_cond_wait(&pf->cond, &pf->lock);
+        if (pf->stopping || pf->next >= pf->npaths)
+            break;
+        int idx = pf->next++;
+        pthread_mutex_unlock(&pf->lock);
+
+        prefetch_file(pf, pf->paths[idx], scratch);
+
+        pthread_mutex_lock(&pf->lock);
+        pf->done[idx] = true;
+        pthread_cond_broadcast(&pf->cond);
+    }
+    pthread_mutex_unlock(&pf->lock);
+    free(scratch);
+    return NULL;
+}
+
+prefetcher_t *start_prefetch(char **paths, int npaths, prefetch_filter_t need_tables) {
+    prefetcher_t *pf = calloc(1, sizeof(prefetcher_t));
+    pf->paths = paths;
+    pf->npaths = npaths;
+    pf->need_tables = need_tables;
+    pf->done = calloc(npaths ? npaths : 1, sizeof(bool));
+    pthread_mutex_init(&pf->lock, NULL);
+    pthread_cond_init(&pf->cond, NULL);
+    for (int i = 0; i < PREFETCH_THREADS && i < npaths; i++) {
+        if (pthread_create(&pf->threads[pf->nthreads], NULL, prefetch_worker, pf) != 0)
+            break; /* fewer threads, or none: the consumer reads synchronously */
+        pf->nthreads++;
+    }
+    return pf;
+}
+
+void wait_prefetch(prefetcher_t *pf, int idx) {
+    pthread_mutex_lock(&pf->lock);
+    pf->consumed = idx;
+    if (pf->next <= idx)
+        pf->next = idx + 1; /* not taken by any thread yet, the consumer reads it itself */
+    else {
+        while (!pf->done[idx])
+            pthread_cond_wait(&pf->cond, &pf->lock);
+    }
+    pthread_cond_broadcast(&pf->cond); /* the window moved */
+    pthread_mutex_unlock(&pf->lock);
+}
+
+void stop_prefetch(prefetcher_t *pf) {
+    pthread_mutex_lock(&pf->lock);
+    pf->stopping = true;
+    pthread_cond_broadcast(&pf->cond);
+    pthread_mutex_unlock(&pf->lock);
+    for (int i = 0; i < pf->nthreads; i++)
+        pthread_join(pf->threads[i], NULL);
+    pthread_mutex_destroy(&pf->lock);
+    pthread_cond_destroy(&pf->cond);
+    free(pf->done);
+    free(pf);
+}
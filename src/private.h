@@ -3,14 +3,25 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <stdbool.h>
 
+#include "sym/resolve.h"
+
 #define ARRAY_LEN(arr) (sizeof(arr) / sizeof((arr)[0]))
+#define PAD8(len) (((len) + 7) & ~(size_t)7)
+
+/* more slices than any FAT file has, larger counts are not FAT headers */
+#define MAX_FAT_ARCHS 16
 
 typedef enum {
 	USAGE_MODE,
 	LOOKUP_MODE,
-	PATCH_MODE
+	PATCH_MODE,
+	WHERE_MODE,
+	WATCH_MODE,
+	APPLY_MODE,
+	REVERT_MODE
 } work_mode_t;
 
 typedef struct {
@@ -23,6 +34,80 @@ typedef struct {
 	data_t x86_64_p, arm64_p;
 } builtin_patch_t;
 
+typedef struct {
+    int32_t cputype;
+    char *name;
+} arch_name_t;
+
+/* return the sum of handler results, fp -> start of the slice when called */
+typedef int (*slice_handler_t)(FILE *fp, long offset, int32_t cputype, void *ctx);
+
+/* slices of a file kept to tell when they change, the ones after MAX_SLICES are ignored */
+#define MAX_SLICES 8
+
+typedef struct {
+    long offset;
+    int32_t cputype;
+    uint8_t uuid[16];  /* LC_UUID, all zero if missing */
+} slice_id_t;
+
+typedef struct {
+    int nslices;
+    slice_id_t slices[MAX_SLICES];
+} slice_scan_t;
+
+typedef struct prefetcher prefetcher_t;
+
+/* return false to skip the __LINKEDIT tables of a slice, e.g. when a cached index answers for it */
+typedef bool (*prefetch_filter_t)(const uint8_t *uuid, int32_t cputype);
+
+typedef enum {
+    PATCH_ERROR,
+    PATCH_WRITTEN,
+    PATCH_ALREADY   /* bytes already equal to the patch */
+} patch_status_t;
+
+typedef struct {
+    patch_off_t poff;
+    const data_t *patch;
+    const data_t *expect;  /* optional pre-image, checked before writing */
+    const uint8_t *uuid;   /* LC_UUID of the slice for the undo log, NULL if unknown */
+    patch_status_t status;
+} patch_site_t;
+
+#define MAX_PAYLOAD_INSNS 16
+
+typedef enum {
+    PAYLOAD_RET,
+    PAYLOAD_MOV,     /* imm into the return register */
+    PAYLOAD_BRANCH,  /* to the target of the payload */
+    PAYLOAD_NOP      /* pad up to imm bytes */
+} payload_op_t;
+
+typedef struct {
+    payload_op_t op;
+    uint64_t imm;
+} payload_insn_t;
+
+/* a parsed patch statement list, compiled for each site */
+typedef struct {
+    int ninsns;
+    payload_insn_t insns[MAX_PAYLOAD_INSNS];
+    char *target;  /* symbol or address of the branch, NULL if none */
+} payload_t;
+
+typedef struct {
+    char *file;
+    char *symbol;
+    data_t x86_64_p, arm64_p;
+    data_t x86_64_e, arm64_e;  /* expected original bytes, optional */
+} manifest_entry_t;
+
+typedef struct {
+    int nentries;
+    manifest_entry_t *entries;
+} manifest_t;
+
 /* defined in builtin.c */
 extern builtin_patch_t builtin_patches[];
 extern int builtin_patches_count;
@@ -32,10 +117,95 @@ extern work_mode_t o_mode;
 extern char *o_symbol, *o_file;
 extern int o_patch_arch;
 extern data_t o_patch_data;
+extern data_t o_expect_data;
 extern bool o_use_builtin_patch;
 extern int o_builtin_idx;
+extern payload_t *o_payload;
 extern bool o_quiet;
+extern char *o_manifest;
+extern char *o_image;
+extern bool o_json;
 
 int parse_arguments(int argc, char **argv);
 
+/* parse a hex string (case-insensitive, whitespace allowed) into a malloc'd buffer */
+int parse_hex(const char *str, data_t *out);
+
+/* defined in patch.c */
+/* 
+ * read the current bytes of all the sites first,
+ * then write only the ones that differ from the patch,
+ * after recording their original bytes in the undo log of path
+ * update status of each site, return the number of failed sites
+ */
+int patch_file(FILE *fp, const char *path, patch_site_t *sites, int nsites);
+
+/* defined in undo.c */
+/* append the original bytes of sites about to be patched to the undo log of path, 0 on success */
+int record_undo(const char *path, patch_site_t *const *sites, const uint8_t *const *originals, int nsites);
+
+/* restore the original bytes of the sites still equal to their patch */
+int revert_file(const char *path);
+
+/* defined in payload.c */
+/* return NULL and print the error if src is not a valid payload */
+payload_t *parse_payload(const char *src);
+
+void free_payload(payload_t *payload);
+
+/* 
+ * encode payload for cputype at vmaddr into a malloc'd buffer,
+ * target is the resolved address of the branch, if any
+ */
+int compile_payload(const payload_t *payload, int32_t cputype, uint64_t vmaddr, uint64_t target, data_t *out);
+
+/* defined in manifest.c */
+manifest_t *load_manifest(const char *path);
+
+void free_manifest(manifest_t *manifest);
+
+/* the patch of an entry for an arch, NULL if not offered */
+const data_t *manifest_patch(const manifest_entry_t *entry, int32_t cputype);
+
+/* the expected bytes of an entry for an arch, NULL if not offered */
+const data_t *manifest_expect(const manifest_entry_t *entry, int32_t cputype);
+
+/* defined in json.c */
+/* buffer an NDJSON record of a match, file is the one of poff */
+void json_record(const char *file, const char *symbol, const patch_off_t *poff);
+
+/* write the buffered records to stdout */
+void json_flush(void);
+
+/* defined in slice.c */
+extern const arch_name_t cpu_archs[];
+extern const int cpu_archs_count;
+
+char *arch2str(int32_t arch);
+
+/* call handler on every slice of a Mach-O or FAT file, -1 if not one of them */
+int for_each_slice(FILE *fp, slice_handler_t handler, void *ctx);
+
+/* the offset, cputype and UUID of every slice, return value of for_each_slice */
+int scan_slices(FILE *fp, slice_scan_t *scan);
+
+/* defined in prefetch.c */
+/* read ahead paths in order on a pool of threads, need_tables may be NULL */
+prefetcher_t *start_prefetch(char **paths, int npaths, prefetch_filter_t need_tables);
+
+/* wait until paths[idx] is read ahead, the pool keeps a window of files after it */
+void wait_prefetch(prefetcher_t *pf, int idx);
+
+void stop_prefetch(prefetcher_t *pf);
+
+/* defined in where.c */
+int where_symbol(const char *symbol_name, const char *dir);
+
+/* defined in watch.c */
+int watch_manifest(const char *path);
+
+/* defined in plan.c */
+/* patch the sites of a manifest once, through its cached binary plan */
+int apply_manifest(const char *path);
+
 #endif
\ No newline at end of file
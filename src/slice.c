@@ -0,0 +1,94 @@
+#include "private.h"
+#include "fileio.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <mach-o/fat.h>
+#include <mach-o/loader.h>
+
+const arch_name_t cpu_archs[] = {
+    {CPU_TYPE_X86_64, "x86_64"},
+    {CPU_TYPE_ARM64, "arm64"}
+};
+
+const int cpu_archs_count = ARRAY_LEN(cpu_archs);
+
+char *arch2str(int32_t arch) {
+    for (int i = 0; i < ARRAY_LEN(cpu_archs); i++) {
+        if (arch == cpu_archs[i].cputype)
+            return cpu_archs[i].name;
+    }
+    return NULL;
+}
+
+/* does a complete 64-bit Mach-O header start at offset */
+static bool is_macho_slice(FILE *fp, long offset, long file_size) {
+    uint32_t magic;
+    if (offset < 0 || file_size - offset < (long)sizeof(struct mach_header_64))
+        return false;
+    fseek(fp, offset, SEEK_SET);
+    return fread(&magic, sizeof(uint32_t), 1, fp) == 1 && magic == MH_MAGIC_64;
+}
+
+int for_each_slice(FILE *fp, slice_handler_t handler, void *ctx) {
+    int total = 0;
+    uint32_t file_magic;
+    fseek(fp, 0, SEEK_END);
+    const long file_size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if (fread(&file_magic, sizeof(uint32_t), 1, fp) != 1)
+        return -1;
+    switch(file_magic) {
+    case MH_MAGIC_64: { /* 64-bit Mach-O file */
+        int32_t cputype;
+        if (!is_macho_slice(fp, 0, file_size) || fread(&cputype, sizeof(int32_t), 1, fp) != 1)
+            return -1;
+        fseek(fp, 0, SEEK_SET);
+        total += handler(fp, 0, cputype, ctx);
+        break;
+    }
+    case FAT_CIGAM: { /* FAT file (on little-endian host CPU), or a java class file */
+        uint32_t nfat_arch;
+        if (fread(&nfat_arch, sizeof(int32_t), 1, fp) != 1)
+            return -1;
+        nfat_arch = OSSwapInt32(nfat_arch);
+        size_t total_size = nfat_arch * sizeof(struct fat_arch);
+        if (nfat_arch == 0 || nfat_arch > MAX_FAT_ARCHS || file_size < sizeof(struct fat_header) + total_size)
+            return -1;
+        struct fat_arch *archs = read_file(fp, total_size);
+        if (archs == NULL)
+            return -1;
+        for (int i = 0; i < nfat_arch; i++) {
+            const int32_t cputype = OSSwapInt32(archs[i].cputype);
+            const uint32_t offset = OSSwapInt32(archs[i].offset);
+            const uint32_t size = OSSwapInt32(archs[i].size);
+            /* 32-bit slices and slices out of the file are skipped */
+            if (offset > file_size || size > file_size - offset || !is_macho_slice(fp, offset, file_size))
+                continue;
+            fseek(fp, offset, SEEK_SET);
+            total += handler(fp, offset, cputype, ctx);
+        }
+        free(archs);
+        break;
+    }
+    default:
+        return -1;
+    }
+    return total;
+}
+
+static int scan_slice(FILE *fp, long offset, int32_t cputype, void *ctx) {
+    slice_scan_t *scan = ctx;
+    if (scan->nslices == MAX_SLICES)
+        return 0;
+    slice_id_t *slice = &scan->slices[scan->nslices++];
+    slice->offset = offset;
+    slice->cputype = cputype;
+    lookup_uuid_macho(fp, slice->uuid);
+    return 1;
+}
+
+int scan_slices(FILE *fp, slice_scan_t *scan) {
+    scan->nslices = 0;
+    return for_each_slice(fp, scan_slice, scan);
+}
@@ -0,0 +1,164 @@
+#include "private.h"
+#include "../fileio.h"
+
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <mach-o/nlist.h>
+
+#define BLOOM_MAGIC 0x314d4f4c42504d53ULL /* "SMPBLOM1" */
+#define BLOOM_BITS_PER_NAME 10
+#define BLOOM_NHASHES 7
+#define TRIE_MAX_DEPTH 1024
+
+typedef struct {
+    uint64_t magic;
+    uint32_t nbits;
+    uint32_t nhashes;
+} bloom_file_header_t;
+
+typedef struct {
+    size_t count, cap;
+    uint64_t *hashes;
+} hash_list_t;
+
+static void hash_list_add(hash_list_t *list, uint64_t hash) {
+    if (list->count < list->cap)
+        list->hashes[list->count++] = hash;
+}
+
+/* hash every exported name without building the strings */
+static void collect_trie(const uint8_t *export, uint32_t export_size, uint64_t node_off,
+                         uint64_t prefix_hash, int depth, hash_list_t *list) {
+    if (node_off >= export_size || depth > TRIE_MAX_DEPTH)
+        return;
+    const uint8_t *cur_pos = export + node_off;
+    uint64_t info_len = read_uleb128(&cur_pos);
+    if (info_len != 0)
+        hash_list_add(list, prefix_hash);
+    cur_pos += info_len;
+    if (cur_pos >= export + export_size)
+        return;
+    uint8_t child_count = *cur_pos++;
+    for (int i = 0; i < child_count; i++) {
+        const char *edge = (const char *)cur_pos;
+        size_t edge_len = strnlen(edge, export + export_size - cur_pos);
+        cur_pos += edge_len + 1;
+        if (cur_pos >= export + export_size)
+            return;
+        uint64_t next_off = read_uleb128(&cur_pos);
+        collect_trie(export, export_size, next_off, hash_update(prefix_hash, edge), depth + 1, list);
+    }
+}
+
+static void bloom_add(symbol_bloom_t *bloom, uint64_t hash) {
+    uint32_t h1 = (uint32_t)hash, h2 = (uint32_t)(hash >> 32) | 1;
+    for (uint32_t i = 0; i < bloom->nhashes; i++) {
+        uint32_t bit = (h1 + i * h2) % bloom->nbits;
+        bloom->bits[bit >> 3] |= 1 << (bit & 7);
+    }
+}
+
+bool bloom_maybe_contains(const symbol_bloom_t *bloom, const char *name) {
+    uint64_t hash = hash_update(HASH_INIT, name);
+    uint32_t h1 = (uint32_t)hash, h2 = (uint32_t)(hash >> 32) | 1;
+    for (uint32_t i = 0; i < bloom->nhashes; i++) {
+        uint32_t bit = (h1 + i * h2) % bloom->nbits;
+        if ((bloom->bits[bit >> 3] & (1 << (bit & 7))) == 0)
+            return false;
+    }
+    return true;
+}
+
+static symbol_bloom_t *build_symbol_bloom(FILE *fp, const macho_symbol_info_t *macho_info, arena_t *arena) {
+    const long base_offset = macho_info->base_offset;
+
+    /* a terminal trie node takes at least 3 bytes */
+    hash_list_t list = {0, macho_info->nsyms + macho_info->export_size / 3 + 1, NULL};
+    list.hashes = arena_alloc(arena, list.cap * sizeof(uint64_t));
+
+    if (macho_info->export_off != 0) {
+        uint8_t *export_trie = read_file_off_arena(arena, fp, macho_info->export_size, base_offset + macho_info->export_off);
+        if (export_trie != NULL)
+            collect_trie(export_trie, macho_info->export_size, 0, HASH_INIT, 0, &list);
+    }
+
+    if (macho_info->symoff != 0) {
+        /* same names as the symtab search in solve_symbol_tables */
+        const struct nlist_64* nl_tbl = read_file_off_arena(arena, fp, macho_info->nsyms * sizeof(struct nlist_64), base_offset + macho_info->symoff);
+        const char* str_tbl = read_file_off_arena(arena, fp, macho_info->strsize, base_offset + macho_info->stroff);
+        if (nl_tbl != NULL && str_tbl != NULL) {
+            for (int i = 0; i < macho_info->nsyms; i++) {
+                if ((nl_tbl[i].n_type & N_TYPE) != N_SECT || nl_tbl[i].n_un.n_strx >= macho_info->strsize)
+                    continue;
+                hash_list_add(&list, hash_update(HASH_INIT, str_tbl + nl_tbl[i].n_un.n_strx));
+            }
+        }
+    }
+
+    uint32_t nbits = (uint32_t)(list.count * BLOOM_BITS_PER_NAME + 63) & ~63U;
+    if (nbits == 0)
+        nbits = 64;
+    symbol_bloom_t *bloom = arena_calloc(arena, sizeof(symbol_bloom_t) + nbits / 8);
+    bloom->nbits = nbits;
+    bloom->nhashes = BLOOM_NHASHES;
+    for (size_t i = 0; i < list.count; i++)
+        bloom_add(bloom, list.hashes[i]);
+    return bloom;
+}
+
+/* the slice uuid names the cache file */
+char *slice_cache_path(const macho_symbol_info_t *macho_info, const char *ext) {
+    static const uint8_t zero_uuid[16] = {0};
+    if (memcmp(macho_info->uuid, zero_uuid, sizeof(zero_uuid)) == 0)
+        return NULL;
+    char name[64];
+    char *p = name;
+    for (int i = 0; i < 16; i++)
+        p += sprintf(p, "%02X", macho_info->uuid[i]);
+    snprintf(p, name + sizeof(name) - p, "-%x.%s", (uint32_t)macho_info->cputype, ext);
+    return cache_file_path(name);
+}
+
+static symbol_bloom_t *read_bloom_cache(const char *path, arena_t *arena) {
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+        return NULL;
+    symbol_bloom_t *bloom = NULL;
+    bloom_file_header_t header;
+    if (fread(&header, sizeof(header), 1, fp) == 1 && header.magic == BLOOM_MAGIC &&
+        header.nbits != 0 && header.nbits % 64 == 0 && header.nhashes - 1 < 32) {
+        bloom = arena_alloc(arena, sizeof(symbol_bloom_t) + header.nbits / 8);
+        bloom->nbits = header.nbits;
+        bloom->nhashes = header.nhashes;
+        if (fread(bloom->bits, header.nbits / 8, 1, fp) != 1)
+            bloom = NULL;
+    }
+    fclose(fp);
+    return bloom;
+}
+
+static void write_bloom_cache(const char *path, const symbol_bloom_t *bloom, arena_t *arena) {
+    size_t len = sizeof(bloom_file_header_t) + bloom->nbits / 8;
+    bloom_file_header_t *header = arena_alloc(arena, len);
+    header->magic = BLOOM_MAGIC;
+    header->nbits = bloom->nbits;
+    header->nhashes = bloom->nhashes;
+    memcpy(header + 1, bloom->bits, bloom->nbits / 8);
+    write_file_atomic(path, header, len); /* cache is optional */
+}
+
+symbol_bloom_t *load_symbol_bloom(FILE *fp, const macho_symbol_info_t *macho_info, arena_t *arena) {
+    char *cache_path = slice_cache_path(macho_info, "bloom");
+    symbol_bloom_t *bloom = NULL;
+    if (cache_path != NULL)
+        bloom = read_bloom_cache(cache_path, arena);
+    if (bloom == NULL) {
+        bloom = build_symbol_bloom(fp, macho_info, arena);
+        if (cache_path != NULL)
+            write_bloom_cache(cache_path, bloom, arena);
+    }
+    free(cache_path);
+    return bloom;
+}
@@ -0,0 +1,717 @@
+#include "private.h"
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <mach-o/nlist.h>
+#include <mach-o/loader.h>
+
+/* copied from dyld source code */
+
+struct dyld_cache_header {
+    char     magic[16];
+    uint32_t mappingOffset;
+    uint32_t mappingCount;
+    uint32_t imagesOffsetOld;
+    uint32_t imagesCountOld;
+    uint64_t dyldBaseAddress;
+    uint64_t codeSignatureOffset;
+    uint64_t codeSignatureSize;
+    uint64_t slideInfoOffsetUnused;
+    uint64_t slideInfoSizeUnused;
+    uint64_t localSymbolsOffset;
+    uint64_t localSymbolsSize;
+    uint8_t  uuid[16];
+    uint64_t cacheType;
+    uint32_t branchPoolsOffset;
+    uint32_t branchPoolsCount;
+    uint64_t dyldInCacheMH;
+    uint64_t dyldInCacheEntry;
+    uint64_t imagesTextOffset;
+    uint64_t imagesTextCount;
+    uint64_t patchInfoAddr;
+    uint64_t patchInfoSize;
+    uint64_t otherImageGroupAddrUnused;
+    uint64_t otherImageGroupSizeUnused;
+    uint64_t progClosuresAddr;
+    uint64_t progClosuresSize;
+    uint64_t progClosuresTrieAddr;
+    uint64_t progClosuresTrieSize;
+    uint32_t platform;
+    uint32_t formatVersionAndFlags;
+    uint64_t sharedRegionStart;
+    uint64_t sharedRegionSize;
+    uint64_t maxSlide;
+    uint64_t dylibsImageArrayAddr;
+    uint64_t dylibsImageArraySize;
+    uint64_t dylibsTrieAddr;
+    uint64_t dylibsTrieSize;
+    uint64_t otherImageArrayAddr;
+    uint64_t otherImageArraySize;
+    uint64_t otherTrieAddr;
+    uint64_t otherTrieSize;
+    uint32_t mappingWithSlideOffset;
+    uint32_t mappingWithSlideCount;
+    uint64_t dylibsPBLStateArrayAddrUnused;
+    uint64_t dylibsPBLSetAddr;
+    uint64_t programsPBLSetPoolAddr;
+    uint64_t programsPBLSetPoolSize;
+    uint64_t programTrieAddr;
+    uint32_t programTrieSize;
+    uint32_t osVersion;
+    uint32_t altPlatform;
+    uint32_t altOsVersion;
+    uint64_t swiftOptsOffset;
+    uint64_t swiftOptsSize;
+    uint32_t subCacheArrayOffset;
+    uint32_t subCacheArrayCount;
+    uint8_t  symbolFileUUID[16];
+    uint64_t rosettaReadOnlyAddr;
+    uint64_t rosettaReadOnlySize;
+    uint64_t rosettaReadWriteAddr;
+    uint64_t rosettaReadWriteSize;
+    uint32_t imagesOffset;
+    uint32_t imagesCount;
+    uint32_t cacheSubType;
+    uint64_t objcOptsOffset;
+    uint64_t objcOptsSize;
+};
+
+struct dyld_cache_mapping_info {
+    uint64_t address;
+    uint64_t size;
+    uint64_t fileOffset;
+    uint32_t maxProt;
+    uint32_t initProt;
+};
+
+struct dyld_cache_mapping_and_slide_info {
+    uint64_t address;
+    uint64_t size;
+    uint64_t fileOffset;
+    uint64_t slideInfoFileOffset;
+    uint64_t slideInfoFileSize;
+    uint64_t flags;
+    uint32_t maxProt;
+    uint32_t initProt;
+};
+
+struct dyld_cache_image_info {
+    uint64_t address;
+    uint64_t modTime;
+    uint64_t inode;
+    uint32_t pathFileOffset;
+    uint32_t pad;
+};
+
+struct dyld_subcache_entry_v1 {
+    uint8_t  uuid[16];
+    uint64_t cacheVMOffset;
+};
+
+struct dyld_subcache_entry {
+    uint8_t  uuid[16];
+    uint64_t cacheVMOffset;
+    char     fileSuffix[32];
+};
+
+struct dyld_cache_local_symbols_info {
+    uint32_t nlistOffset;
+    uint32_t nlistCount;
+    uint32_t stringsOffset;
+    uint32_t stringsSize;
+    uint32_t entriesOffset;
+    uint32_t entriesCount;
+};
+
+struct dyld_cache_local_symbols_entry {
+    uint32_t dylibOffset;
+    uint32_t nlistStartIndex;
+    uint32_t nlistCount;
+};
+
+struct dyld_cache_local_symbols_entry_64 {
+    uint64_t dylibOffset;
+    uint32_t nlistStartIndex;
+    uint32_t nlistCount;
+};
+
+struct dyld_cache_slide_info2 {
+    uint32_t version;
+    uint32_t page_size;
+    uint32_t page_starts_offset;
+    uint32_t page_starts_count;
+    uint32_t page_extras_offset;
+    uint32_t page_extras_count;
+    uint64_t delta_mask;
+    uint64_t value_add;
+};
+
+/* v3 and v5 */
+struct dyld_cache_slide_info3 {
+    uint32_t version;
+    uint32_t page_size;
+    uint32_t page_starts_count;
+    uint32_t pad;
+    uint64_t auth_value_add;
+};
+
+struct objc_opt_header {
+    uint32_t version;
+    uint32_t flags;
+    uint64_t headerInfoROCacheOffset;
+    uint64_t headerInfoRWCacheOffset;
+    uint64_t selectorHashTableCacheOffset;
+    uint64_t classHashTableCacheOffset;
+    uint64_t protocolHashTableCacheOffset;
+    uint64_t relativeMethodSelectorBaseAddressOffset;
+};
+
+/* the header is as large as mappingOffset, newer fields are missing in old caches */
+#define HAS_FIELD(header, field) \
+    ((header)->mappingOffset >= offsetof(struct dyld_cache_header, field) + sizeof((header)->field))
+
+typedef struct {
+    char *path;
+    const uint8_t *base;  /* mmap of the whole file */
+    size_t size;
+    const struct dyld_cache_header *header;
+    const struct dyld_cache_mapping_info *mappings;
+    uint32_t nmappings;
+
+    /* how pointers in the __DATA mappings are encoded */
+    uint32_t slide_version;
+    uint64_t delta_mask;
+    uint64_t value_add;
+} cache_file_t;
+
+struct dyld_cache {
+    int32_t cputype;
+    uint64_t base_address;  /* vmaddr of the main cache header */
+    uint64_t sel_base;      /* base of relative method selectors, 0 if unknown */
+
+    int nfiles;
+    cache_file_t *files;    /* main cache first, then the subcaches */
+    cache_file_t *locals;   /* file with the local symbols, NULL if stripped */
+    cache_file_t symbols;   /* .symbols file, base is NULL if missing */
+};
+
+typedef struct {
+    uint64_t address;        /* vmaddr of the mach header */
+    uint64_t text_vmaddr;
+    uint64_t text_sect_end;  /* vm end of __TEXT,__text */
+    uint64_t linkedit_bias;  /* vmaddr - fileoff of __LINKEDIT */
+
+    uint32_t symoff, nsyms, stroff, strsize;
+    uint32_t export_off, export_size;
+    uint32_t funcstarts_off, funcstarts_size;
+
+    uint64_t classlist_addr;
+    uint64_t classlist_size;
+    uint64_t catlist_addr;
+    uint64_t catlist_size;
+} cache_image_info_t;
+
+static int map_cache_file(cache_file_t *file, const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return 1;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < sizeof(struct dyld_cache_header)) {
+        close(fd);
+        return 1;
+    }
+    void *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return 1;
+    file->base = base;
+    file->size = st.st_size;
+    file->header = base;
+    if (strncmp(file->header->magic, "dyld_v1", 7) != 0) {
+        munmap(base, st.st_size);
+        file->base = NULL;
+        return 1;
+    }
+    file->path = strdup(path);
+    return 0;
+}
+
+static void unmap_cache_file(cache_file_t *file) {
+    if (file->base != NULL)
+        munmap((void *)file->base, file->size);
+    free(file->path);
+}
+
+static const void *file_data(const cache_file_t *file, uint64_t offset, uint64_t len) {
+    if (offset > file->size || file->size - offset < len)
+        return NULL;
+    return file->base + offset;
+}
+
+static int load_mappings(cache_file_t *file) {
+    const struct dyld_cache_header *header = file->header;
+    file->nmappings = header->mappingCount;
+    file->mappings = file_data(file, header->mappingOffset, (uint64_t)file->nmappings * sizeof(struct dyld_cache_mapping_info));
+    if (file->mappings == NULL)
+        return 1;
+
+    /* pointer format from the first slide info of the file */
+    const uint32_t *slide_info = NULL;
+    if (HAS_FIELD(header, mappingWithSlideCount) && header->mappingWithSlideOffset != 0) {
+        const struct dyld_cache_mapping_and_slide_info *slide_mappings = file_data(file, header->mappingWithSlideOffset,
+            (uint64_t)header->mappingWithSlideCount * sizeof(struct dyld_cache_mapping_and_slide_info));
+        for (int i = 0; slide_mappings != NULL && i < header->mappingWithSlideCount; i++) {
+            if (slide_mappings[i].slideInfoFileSize != 0) {
+                slide_info = file_data(file, slide_mappings[i].slideInfoFileOffset, sizeof(struct dyld_cache_slide_info2));
+                break;
+            }
+        }
+    }
+    else if (header->slideInfoOffsetUnused != 0) {
+        slide_info = file_data(file, header->slideInfoOffsetUnused, sizeof(struct dyld_cache_slide_info2));
+    }
+    if (slide_info == NULL)
+        return 0; /* plain pointers */
+    file->slide_version = slide_info[0];
+    if (file->slide_version == 2) {
+        const struct dyld_cache_slide_info2 *info2 = (const void *)slide_info;
+        file->delta_mask = info2->delta_mask;
+        file->value_add = info2->value_add;
+    }
+    else if (file->slide_version == 3 || file->slide_version == 5) {
+        const struct dyld_cache_slide_info3 *info3 = (const void *)slide_info;
+        file->value_add = info3->auth_value_add;
+    }
+    return 0;
+}
+
+static char *subcache_path(const char *path, const struct dyld_cache_header *header, int idx) {
+    char suffix[40];
+    const uint8_t *entries = (const uint8_t *)header + header->subCacheArrayOffset;
+    if (header->mappingOffset <= offsetof(struct dyld_cache_header, cacheSubType))
+        snprintf(suffix, sizeof(suffix), ".%d", idx + 1);
+    else {
+        const struct dyld_subcache_entry *entry = (const void *)(entries + idx * sizeof(struct dyld_subcache_entry));
+        snprintf(suffix, sizeof(suffix), "%.*s", (int)sizeof(entry->fileSuffix), entry->fileSuffix);
+    }
+    char *sub_path = malloc(strlen(path) + strlen(suffix) + 1);
+    strcpy(sub_path, path);
+    strcat(sub_path, suffix);
+    return sub_path;
+}
+
+static int32_t cache_cputype(const char *magic) {
+    /* "dyld_v1" then the right aligned arch name */
+    const char *arch = magic + 7;
+    while (*arch == ' ')
+        arch++;
+    if (strncmp(arch, "arm64", 5) == 0 && strcmp(arch, "arm64_32") != 0)
+        return CPU_TYPE_ARM64;
+    if (strncmp(arch, "x86_64", 6) == 0)
+        return CPU_TYPE_X86_64;
+    return 0;
+}
+
+static const cache_file_t *find_file(const dyld_cache_t *cache, uint64_t vmaddr, uint64_t *fileoff) {
+    for (int i = 0; i < cache->nfiles; i++) {
+        const cache_file_t *file = &cache->files[i];
+        for (int j = 0; j < file->nmappings; j++) {
+            const struct dyld_cache_mapping_info *mapping = &file->mappings[j];
+            if (vmaddr >= mapping->address && vmaddr - mapping->address < mapping->size) {
+                *fileoff = mapping->fileOffset + (vmaddr - mapping->address);
+                return file;
+            }
+        }
+    }
+    return NULL;
+}
+
+static const void *cache_vm_data(const void *ctx, uint64_t vmaddr, size_t len) {
+    uint64_t fileoff;
+    const cache_file_t *file = find_file(ctx, vmaddr, &fileoff);
+    if (file == NULL)
+        return NULL;
+    return file_data(file, fileoff, len);
+}
+
+static uint64_t cache_vm_ptr(const void *ctx, uint64_t vmaddr) {
+    uint64_t fileoff;
+    const cache_file_t *file = find_file(ctx, vmaddr, &fileoff);
+    const uint64_t *ptr = file != NULL ? file_data(file, fileoff, sizeof(uint64_t)) : NULL;
+    if (ptr == NULL)
+        return 0;
+    uint64_t raw = *ptr;
+    switch (file->slide_version) {
+    case 2:
+        raw &= ~file->delta_mask;
+        return raw != 0 ? raw + file->value_add : 0;
+    case 3:
+        if ((raw >> 63) != 0) /* authenticated, offset from the cache */
+            return file->value_add + (uint32_t)raw;
+        /* high8 in bits 43-50 moves to the top byte, vmaddr in the low 43 bits */
+        return ((raw & 0x0007F80000000000ULL) << 13) | (raw & 0x000007FFFFFFFFFFULL);
+    case 5:
+        return raw != 0 ? file->value_add + (raw & 0x3FFFFFFFFULL) : 0;
+    default:
+        return raw;
+    }
+}
+
+long cache_vm_to_file(const dyld_cache_t *cache, uint64_t vmaddr, const char **path) {
+    uint64_t fileoff;
+    const cache_file_t *file = find_file(cache, vmaddr, &fileoff);
+    if (file == NULL)
+        return -1;
+    *path = file->path;
+    return (long)fileoff;
+}
+
+dyld_cache_t *open_dyld_cache(const char *path) {
+    dyld_cache_t *cache = calloc(1, sizeof(dyld_cache_t));
+    cache->files = calloc(1, sizeof(cache_file_t));
+    if (map_cache_file(&cache->files[0], path) != 0) {
+        free(cache->files);
+        free(cache);
+        return NULL;
+    }
+    cache->nfiles = 1;
+
+    const cache_file_t *main_file = &cache->files[0];
+    const struct dyld_cache_header *header = main_file->header;
+    cache->cputype = cache_cputype(header->magic);
+    if (cache->cputype == 0) {
+        fprintf(stderr, "symp: unsupported dyld shared cache '%.16s'\n", header->magic);
+        goto err;
+    }
+    if (load_mappings(&cache->files[0]) != 0 || main_file->nmappings == 0) {
+        fprintf(stderr, "symp: %s: invalid dyld shared cache mappings\n", path);
+        goto err;
+    }
+    cache->base_address = main_file->mappings[0].address;
+
+    if (HAS_FIELD(header, subCacheArrayCount) && header->subCacheArrayCount != 0) {
+        size_t entry_size = header->mappingOffset <= offsetof(struct dyld_cache_header, cacheSubType) ?
+            sizeof(struct dyld_subcache_entry_v1) : sizeof(struct dyld_subcache_entry);
+        if (file_data(main_file, header->subCacheArrayOffset, header->subCacheArrayCount * entry_size) == NULL) {
+            fprintf(stderr, "symp: %s: invalid subcache array\n", path);
+            goto err;
+        }
+        const uint32_t nsubcaches = header->subCacheArrayCount;
+        cache->files = realloc(cache->files, (nsubcaches + 1) * sizeof(cache_file_t));
+        memset(cache->files + 1, 0, nsubcaches * sizeof(cache_file_t));
+        main_file = &cache->files[0];
+        header = main_file->header;
+        for (int i = 0; i < nsubcaches; i++) {
+            char *sub_path = subcache_path(path, header, i);
+            cache_file_t *sub_file = &cache->files[cache->nfiles];
+            int ret = map_cache_file(sub_file, sub_path);
+            if (ret == 0) {
+                cache->nfiles++;
+                ret = load_mappings(sub_file);
+            }
+            if (ret != 0) {
+                fprintf(stderr, "symp: missing or invalid subcache %s\n", sub_path);
+                free(sub_path);
+                goto err;
+            }
+            free(sub_path);
+        }
+    }
+
+    /* local symbols are in a .symbols file since the subcaches, in the main cache before */
+    static const uint8_t zero_uuid[16] = {0};
+    if (HAS_FIELD(header, symbolFileUUID) && memcmp(header->symbolFileUUID, zero_uuid, sizeof(zero_uuid)) != 0) {
+        char *symbols_path = malloc(strlen(path) + sizeof(".symbols"));
+        strcpy(symbols_path, path);
+        strcat(symbols_path, ".symbols");
+        if (map_cache_file(&cache->symbols, symbols_path) == 0)
+            cache->locals = &cache->symbols;
+        else
+            fprintf(stderr, "symp: warning, %s not found, local symbols are not searched\n", symbols_path);
+        free(symbols_path);
+    }
+    else if (header->localSymbolsOffset != 0) {
+        cache->locals = &cache->files[0];
+    }
+
+    if (HAS_FIELD(header, objcOptsOffset) && header->objcOptsOffset != 0) {
+        const struct objc_opt_header *objc_opt = cache_vm_data(cache, cache->base_address + header->objcOptsOffset, sizeof(struct objc_opt_header));
+        if (objc_opt != NULL && objc_opt->relativeMethodSelectorBaseAddressOffset != 0)
+            cache->sel_base = cache->base_address + objc_opt->relativeMethodSelectorBaseAddressOffset;
+    }
+    return cache;
+
+err:
+    close_dyld_cache(cache);
+    return NULL;
+}
+
+void close_dyld_cache(dyld_cache_t *cache) {
+    for (int i = 0; i < cache->nfiles; i++)
+        unmap_cache_file(&cache->files[i]);
+    unmap_cache_file(&cache->symbols);
+    free(cache->files);
+    free(cache);
+}
+
+int32_t dyld_cache_cputype(const dyld_cache_t *cache) {
+    return cache->cputype;
+}
+
+static bool parse_cache_image(const dyld_cache_t *cache, uint64_t address, cache_image_info_t *info) {
+    memset(info, 0, sizeof(cache_image_info_t));
+    info->address = address;
+    const struct mach_header_64 *header = cache_vm_data(cache, address, sizeof(struct mach_header_64));
+    if (header == NULL || header->magic != MH_MAGIC_64)
+        return false;
+    const uint8_t *cmds = cache_vm_data(cache, address + sizeof(struct mach_header_64), header->sizeofcmds);
+    if (cmds == NULL)
+        return false;
+
+    const uint8_t *cur_pos = cmds;
+    for (int i = 0; i < header->ncmds; i++) {
+        const struct load_command *lc = (const void *)cur_pos;
+        if (cur_pos + sizeof(struct load_command) > cmds + header->sizeofcmds ||
+            lc->cmdsize < sizeof(struct load_command) || cur_pos + lc->cmdsize > cmds + header->sizeofcmds)
+            break;
+        switch (lc->cmd) {
+        case LC_SEGMENT_64: {
+            const struct segment_command_64 *seg = (const void *)lc;
+            const struct section_64 *sects = (const void *)(seg + 1);
+            if (strncmp(seg->segname, SEG_TEXT, 16) == 0)
+                info->text_vmaddr = seg->vmaddr;
+            else if (strncmp(seg->segname, SEG_LINKEDIT, 16) == 0)
+                info->linkedit_bias = seg->vmaddr - seg->fileoff;
+            for (int j = 0; j < seg->nsects && (const uint8_t *)&sects[j + 1] <= cur_pos + lc->cmdsize; j++) {
+                if (strncmp(seg->segname, SEG_TEXT, 16) == 0 && strncmp(sects[j].sectname, SECT_TEXT, 16) == 0)
+                    info->text_sect_end = sects[j].addr + sects[j].size;
+                else if (strncmp(seg->segname, "__DATA", 6) == 0 && strncmp(sects[j].sectname, "__objc_classlist", 16) == 0) {
+                    info->classlist_addr = sects[j].addr;
+                    info->classlist_size = sects[j].size;
+                }
+                else if (strncmp(seg->segname, "__DATA", 6) == 0 && strncmp(sects[j].sectname, "__objc_catlist", 16) == 0) {
+                    info->catlist_addr = sects[j].addr;
+                    info->catlist_size = sects[j].size;
+                }
+            }
+            break;
+        }
+        case LC_SYMTAB: {
+            const struct symtab_command *symtab = (const void *)lc;
+            info->symoff = symtab->symoff;
+            info->nsyms = symtab->nsyms;
+            info->stroff = symtab->stroff;
+            info->strsize = symtab->strsize;
+            break;
+        }
+        case LC_DYLD_INFO:
+        case LC_DYLD_INFO_ONLY: {
+            const struct dyld_info_command *dyld_info = (const void *)lc;
+            info->export_off = dyld_info->export_off;
+            info->export_size = dyld_info->export_size;
+            break;
+        }
+        case LC_DYLD_EXPORTS_TRIE:
+        case LC_FUNCTION_STARTS: {
+            const struct linkedit_data_command *linkedit = (const void *)lc;
+            if (lc->cmd == LC_DYLD_EXPORTS_TRIE) {
+                info->export_off = linkedit->dataoff;
+                info->export_size = linkedit->datasize;
+            }
+            else {
+                info->funcstarts_off = linkedit->dataoff;
+                info->funcstarts_size = linkedit->datasize;
+            }
+            break;
+        }
+        default:
+            break;
+        }
+        cur_pos += lc->cmdsize;
+    }
+    return true;
+}
+
+/* the __LINKEDIT of all images is shared, offsets are mapped with the bias of the image */
+static const void *linkedit_data(const dyld_cache_t *cache, const cache_image_info_t *info, uint32_t offset, uint64_t len) {
+    if (len == 0 || info->linkedit_bias == 0)
+        return NULL;
+    return cache_vm_data(cache, info->linkedit_bias + offset, len);
+}
+
+static uint64_t solve_image_symbol(const dyld_cache_t *cache, const cache_image_info_t *info, const char *symbol_name, symsrc_t *source) {
+    const uint8_t *export_trie = linkedit_data(cache, info, info->export_off, info->export_size);
+    if (export_trie != NULL) {
+        uint64_t offset = trie_query(export_trie, symbol_name);
+        if (offset != 0) {
+            *source = SOURCE_EXPORT;
+            return info->address + offset;
+        }
+    }
+
+    const struct nlist_64 *nl_tbl = linkedit_data(cache, info, info->symoff, (uint64_t)info->nsyms * sizeof(struct nlist_64));
+    const char *str_tbl = linkedit_data(cache, info, info->stroff, info->strsize);
+    if (nl_tbl == NULL || str_tbl == NULL)
+        return 0;
+    for (int i = 0; i < info->nsyms; i++) {
+        if ((nl_tbl[i].n_type & N_TYPE) != N_SECT || nl_tbl[i].n_un.n_strx >= info->strsize)
+            continue;
+        if (strcmp(symbol_name, str_tbl + nl_tbl[i].n_un.n_strx) == 0) {
+            *source = SOURCE_SYMTAB;
+            return nl_tbl[i].n_value;
+        }
+    }
+    return 0;
+}
+
+/* the unexported symbols stripped from the images are kept aside */
+static uint64_t solve_local_symbol(const dyld_cache_t *cache, const cache_image_info_t *info, const char *symbol_name) {
+    const cache_file_t *file = cache->locals;
+    if (file == NULL)
+        return 0;
+    const uint64_t info_off = file->header->localSymbolsOffset;
+    const struct dyld_cache_local_symbols_info *locals = file_data(file, info_off, sizeof(struct dyld_cache_local_symbols_info));
+    if (locals == NULL)
+        return 0;
+    const struct nlist_64 *nl_tbl = file_data(file, info_off + locals->nlistOffset, (uint64_t)locals->nlistCount * sizeof(struct nlist_64));
+    const char *str_tbl = file_data(file, info_off + locals->stringsOffset, locals->stringsSize);
+    if (nl_tbl == NULL || str_tbl == NULL)
+        return 0;
+
+    /* the entries are keyed by vm offset in newer caches, by file offset before */
+    const bool entry_64 = cache->files[0].header->mappingOffset >= offsetof(struct dyld_cache_header, symbolFileUUID);
+    uint64_t dylib_offset = info->address - cache->base_address;
+    if (!entry_64) {
+        const char *path;
+        dylib_offset = cache_vm_to_file(cache, info->address, &path);
+    }
+    const size_t entry_size = entry_64 ? sizeof(struct dyld_cache_local_symbols_entry_64) : sizeof(struct dyld_cache_local_symbols_entry);
+    const uint8_t *entries = file_data(file, info_off + locals->entriesOffset, (uint64_t)locals->entriesCount * entry_size);
+    if (entries == NULL)
+        return 0;
+    for (int i = 0; i < locals->entriesCount; i++) {
+        uint64_t entry_dylib_offset;
+        uint32_t start, count;
+        if (entry_64) {
+            const struct dyld_cache_local_symbols_entry_64 *entry = (const void *)(entries + i * entry_size);
+            entry_dylib_offset = entry->dylibOffset;
+            start = entry->nlistStartIndex;
+            count = entry->nlistCount;
+        }
+        else {
+            const struct dyld_cache_local_symbols_entry *entry = (const void *)(entries + i * entry_size);
+            entry_dylib_offset = entry->dylibOffset;
+            start = entry->nlistStartIndex;
+            count = entry->nlistCount;
+        }
+        if (entry_dylib_offset != dylib_offset)
+            continue;
+        if (start > locals->nlistCount || locals->nlistCount - start < count)
+            return 0;
+        for (uint32_t j = start; j < start + count; j++) {
+            if ((nl_tbl[j].n_type & N_TYPE) != N_SECT || nl_tbl[j].n_un.n_strx >= locals->stringsSize)
+                continue;
+            if (strcmp(symbol_name, str_tbl + nl_tbl[j].n_un.n_strx) == 0)
+                return nl_tbl[j].n_value;
+        }
+        return 0;
+    }
+    return 0;
+}
+
+static bool match_image_name(const char *install_name, const char *image_name) {
+    if (strcmp(install_name, image_name) == 0)
+        return true;
+    const char *slash = strrchr(install_name, '/');
+    return slash != NULL && strcmp(slash + 1, image_name) == 0;
+}
+
+/* the image array of the cache, NULL if it is not mapped */
+static const struct dyld_cache_image_info *cache_images(const dyld_cache_t *cache, uint32_t *nimages) {
+    const cache_file_t *main_file = &cache->files[0];
+    const struct dyld_cache_header *header = main_file->header;
+    uint32_t images_off = header->imagesOffsetOld;
+    *nimages = header->imagesCountOld;
+    if (HAS_FIELD(header, imagesCount) && header->imagesOffset != 0)
+        images_off = header->imagesOffset, *nimages = header->imagesCount;
+    const struct dyld_cache_image_info *images = file_data(main_file, images_off, (uint64_t)*nimages * sizeof(struct dyld_cache_image_info));
+    if (images == NULL)
+        fprintf(stderr, "symp: invalid image array in the dyld shared cache\n");
+    return images;
+}
+
+/* max patch length at vmaddr in the image, bounded by its function starts */
+static uint32_t image_extent(const dyld_cache_t *cache, const cache_image_info_t *info, uint64_t vmaddr, arena_t *arena) {
+    const uint8_t *data = linkedit_data(cache, info, info->funcstarts_off, info->funcstarts_size);
+    const macho_func_starts_t *func_starts = decode_function_starts(data, data != NULL ? info->funcstarts_size : 0,
+                                                                    info->text_vmaddr, 0, info->text_sect_end, arena);
+    return function_extent(func_starts, vmaddr);
+}
+
+uint64_t solve_cache_symbol(const dyld_cache_t *cache, const char *image_name, const char *symbol_name, bool objc, symsrc_t *source, uint32_t *maxplen, arena_t *arena) {
+    const cache_file_t *main_file = &cache->files[0];
+    uint32_t nimages;
+    const struct dyld_cache_image_info *images = cache_images(cache, &nimages);
+    if (images == NULL)
+        return 0;
+
+    bool image_found = false;
+    for (int i = 0; i < nimages; i++) {
+        const char *install_name = file_data(main_file, images[i].pathFileOffset, 1);
+        if (image_name != NULL && (install_name == NULL || !match_image_name(install_name, image_name)))
+            continue;
+        image_found = true;
+        cache_image_info_t info;
+        if (!parse_cache_image(cache, images[i].address, &info))
+            continue;
+
+        uint64_t vmaddr = 0;
+        if (objc) {
+            /* classes of categories are bound in the cache already */
+            const objc_image_t image = {
+                cache, cache_vm_data, cache_vm_ptr, NULL, cache->sel_base,
+                info.classlist_addr, info.classlist_size, info.catlist_addr, info.catlist_size
+            };
+            if (info.classlist_addr != 0 || info.catlist_addr != 0)
+                vmaddr = solve_objc_image(&image, symbol_name, arena);
+            *source = SOURCE_OBJC;
+        }
+        else {
+            vmaddr = solve_image_symbol(cache, &info, symbol_name, source);
+            if (vmaddr == 0) {
+                vmaddr = solve_local_symbol(cache, &info, symbol_name);
+                *source = SOURCE_SYMTAB;
+            }
+        }
+        if (vmaddr == 0)
+            continue;
+
+        *maxplen = image_extent(cache, &info, vmaddr, arena);
+        return vmaddr;
+    }
+    if (image_name != NULL && !image_found)
+        fprintf(stderr, "symp: image '%s' not found in the dyld shared cache\n", image_name);
+    return 0;
+}
+
+uint32_t cache_address_extent(const dyld_cache_t *cache, uint64_t vmaddr, arena_t *arena) {
+    uint32_t nimages;
+    const struct dyld_cache_image_info *images = cache_images(cache, &nimages);
+    if (images == NULL)
+        return 0;
+    for (uint32_t i = 0; i < nimages; i++) {
+        cache_image_info_t info;
+        /* __text follows the mach header of its image */
+        if (images[i].address > vmaddr || !parse_cache_image(cache, images[i].address, &info))
+            continue;
+        if (vmaddr >= info.text_vmaddr && vmaddr < info.text_sect_end)
+            return image_extent(cache, &info, vmaddr, arena);
+    }
+    return 0;
+}
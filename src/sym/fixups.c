@@ -0,0 +1,186 @@
+#include "private.h"
+#include "../fileio.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mach-o/fixup-chains.h>
+
+typedef struct {
+    const uint8_t *macho_data;
+    uint64_t dataend_off;
+    uint64_t vm_slide;
+    uint64_t text_vmaddr;  /* image base, targets and segment offsets are relative to it */
+} chain_ctx_t;
+
+/* bytes per unit of next, 0 for the 32-bit and kernel formats we do not handle */
+static uint32_t pointer_stride(uint16_t format) {
+    switch (format) {
+    case DYLD_CHAINED_PTR_ARM64E:
+    case DYLD_CHAINED_PTR_ARM64E_USERLAND:
+    case DYLD_CHAINED_PTR_ARM64E_USERLAND24:
+        return 8;
+    case DYLD_CHAINED_PTR_64:
+    case DYLD_CHAINED_PTR_64_OFFSET:
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+/* return the target vmaddr or FIXUP_BIND | ordinal, set the next of the chain */
+static uint64_t decode_pointer(const chain_ctx_t *ctx, uint16_t format, uint64_t raw, uint32_t *next) {
+    if (format == DYLD_CHAINED_PTR_64 || format == DYLD_CHAINED_PTR_64_OFFSET) {
+        /* dyld_chained_ptr_64_rebase / dyld_chained_ptr_64_bind */
+        *next = (raw >> 51) & 0xFFF;
+        if ((raw >> 63) != 0)
+            return FIXUP_BIND | (raw & 0xFFFFFF);
+        uint64_t target = raw & 0xFFFFFFFFFULL;
+        return format == DYLD_CHAINED_PTR_64_OFFSET ? ctx->text_vmaddr + target : target;
+    }
+
+    /* dyld_chained_ptr_arm64e_* */
+    *next = (raw >> 51) & 0x7FF;
+    const bool bind = (raw >> 62) & 1, auth = (raw >> 63) & 1;
+    if (bind)
+        return FIXUP_BIND | (raw & (format == DYLD_CHAINED_PTR_ARM64E_USERLAND24 ? 0xFFFFFF : 0xFFFF));
+    if (auth) /* always an offset from the image */
+        return ctx->text_vmaddr + (raw & 0xFFFFFFFF);
+    uint64_t target = raw & 0x7FFFFFFFFFFULL;
+    return format == DYLD_CHAINED_PTR_ARM64E ? target : ctx->text_vmaddr + target;
+}
+
+/* walk the chains of a segment, fill out if not NULL, return the number of fixups */
+static uint64_t walk_segment(const chain_ctx_t *ctx, const struct dyld_chained_starts_in_segment *seg, chained_fixup_t *out) {
+    const uint32_t stride = pointer_stride(seg->pointer_format);
+    if (stride == 0)
+        return 0;
+    uint64_t nfixups = 0;
+    for (int i = 0; i < seg->page_count; i++) {
+        uint16_t start = seg->page_start[i];
+        if (start == DYLD_CHAINED_PTR_START_NONE)
+            continue;
+        uint64_t vmaddr = ctx->text_vmaddr + seg->segment_offset + (uint64_t)i * seg->page_size + start;
+        while (1) {
+            uint64_t fileoff = vmaddr + ctx->vm_slide;
+            if (fileoff >= ctx->dataend_off || ctx->dataend_off - fileoff < sizeof(uint64_t))
+                break;
+            uint64_t raw;
+            memcpy(&raw, ctx->macho_data + fileoff, sizeof(raw));
+            uint32_t next;
+            uint64_t target = decode_pointer(ctx, seg->pointer_format, raw, &next);
+            if (out != NULL) {
+                out[nfixups].vmaddr = vmaddr;
+                out[nfixups].target = target;
+            }
+            nfixups++;
+            if (next == 0)
+                break;
+            vmaddr += next * stride;
+        }
+    }
+    return nfixups;
+}
+
+static int cmp_fixup(const void *a, const void *b) {
+    const chained_fixup_t *fa = a, *fb = b;
+    if (fa->vmaddr != fb->vmaddr)
+        return fa->vmaddr < fb->vmaddr ? -1 : 1;
+    return 0;
+}
+
+/* names of the imports, NULL if compressed or out of range */
+static void parse_imports(const uint8_t *data, uint32_t size, macho_fixups_t *fixups, arena_t *arena) {
+    const struct dyld_chained_fixups_header *header = (const void *)data;
+    fixups->nimports = header->imports_count;
+    fixups->import_names = arena_calloc(arena, (header->imports_count ? header->imports_count : 1) * sizeof(char *));
+    size_t import_size = sizeof(struct dyld_chained_import);
+    if (header->imports_format == DYLD_CHAINED_IMPORT_ADDEND)
+        import_size = sizeof(struct dyld_chained_import_addend);
+    else if (header->imports_format == DYLD_CHAINED_IMPORT_ADDEND64)
+        import_size = sizeof(struct dyld_chained_import_addend64);
+    if (header->symbols_format != 0 || header->imports_offset > size ||
+        (size - header->imports_offset) / import_size < header->imports_count)
+        return;
+
+    for (uint32_t i = 0; i < header->imports_count; i++) {
+        const uint8_t *import = data + header->imports_offset + i * import_size;
+        uint64_t name_offset;
+        if (header->imports_format == DYLD_CHAINED_IMPORT_ADDEND64) {
+            uint64_t value;
+            memcpy(&value, import, sizeof(value));
+            name_offset = value >> 32;
+        }
+        else {
+            uint32_t value;
+            memcpy(&value, import, sizeof(value));
+            name_offset = value >> 9;
+        }
+        if (header->symbols_offset + name_offset < size)
+            fixups->import_names[i] = (const char *)data + header->symbols_offset + name_offset;
+    }
+}
+
+macho_fixups_t *parse_chained_fixups(FILE *fp, const macho_objc_info_t *macho_info, const uint8_t *macho_data, arena_t *arena) {
+    const uint32_t size = macho_info->chained_fixups_size;
+    if (macho_info->chained_fixups_off == 0 || size < sizeof(struct dyld_chained_fixups_header))
+        return NULL;
+    const uint8_t *data = read_file_off_arena(arena, fp, size, macho_info->base_offset + macho_info->chained_fixups_off);
+    if (data == NULL)
+        return NULL;
+    const struct dyld_chained_fixups_header *header = (const void *)data;
+    if (header->starts_offset > size - sizeof(uint32_t))
+        return NULL;
+    const struct dyld_chained_starts_in_image *starts = (const void *)(data + header->starts_offset);
+    if ((size - header->starts_offset - sizeof(uint32_t)) / sizeof(uint32_t) < starts->seg_count)
+        return NULL;
+
+    const chain_ctx_t ctx = {macho_data, macho_info->dataend_off, macho_info->vm_slide, macho_info->text_vmaddr};
+    const struct dyld_chained_starts_in_segment *segs[starts->seg_count ? starts->seg_count : 1];
+    uint64_t nfixups = 0;
+    for (int i = 0; i < starts->seg_count; i++) {
+        segs[i] = NULL;
+        uint32_t seg_off = header->starts_offset + starts->seg_info_offset[i];
+        if (starts->seg_info_offset[i] == 0 || seg_off > size || size - seg_off < sizeof(struct dyld_chained_starts_in_segment))
+            continue;
+        segs[i] = (const void *)(data + seg_off);
+        if ((size - seg_off - offsetof(struct dyld_chained_starts_in_segment, page_start)) / sizeof(uint16_t) < segs[i]->page_count) {
+            segs[i] = NULL;
+            continue;
+        }
+        nfixups += walk_segment(&ctx, segs[i], NULL);
+    }
+
+    /* count first, then fill the table in one allocation */
+    macho_fixups_t *fixups = arena_alloc(arena, sizeof(macho_fixups_t) + nfixups * sizeof(chained_fixup_t));
+    fixups->nfixups = 0;
+    bool sorted = true;
+    for (int i = 0; i < starts->seg_count; i++) {
+        if (segs[i] == NULL)
+            continue;
+        uint64_t first = fixups->nfixups;
+        fixups->nfixups += walk_segment(&ctx, segs[i], fixups->fixups + first);
+        if (first != 0 && first < fixups->nfixups && fixups->fixups[first].vmaddr < fixups->fixups[first - 1].vmaddr)
+            sorted = false;
+    }
+    /* chains go forward, only segments out of order need a sort */
+    if (!sorted)
+        qsort(fixups->fixups, fixups->nfixups, sizeof(chained_fixup_t), cmp_fixup);
+    parse_imports(data, size, fixups, arena);
+    return fixups;
+}
+
+const chained_fixup_t *find_fixup(const macho_fixups_t *fixups, uint64_t vmaddr) {
+    uint64_t lo = 0, hi = fixups->nfixups;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (fixups->fixups[mid].vmaddr < vmaddr)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo < fixups->nfixups && fixups->fixups[lo].vmaddr == vmaddr)
+        return &fixups->fixups[lo];
+    return NULL;
+}
@@ -0,0 +1,69 @@
+#include "private.h"
+#include "../fileio.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+macho_func_starts_t *decode_function_starts(const uint8_t *data, uint32_t size, uint64_t text_vmaddr, uint64_t vm_slide, uint64_t text_sect_end, arena_t *arena) {
+    /* every uleb128 takes at least one byte, size is an upper bound of the count */
+    macho_func_starts_t *func_starts = arena_alloc(arena, sizeof(macho_func_starts_t) + size * sizeof(uint64_t));
+    func_starts->text_sect_end = text_sect_end;
+    func_starts->nstarts = 0;
+    if (data == NULL)
+        return func_starts;
+
+    /* deltas of uleb128, the first one is from the start of __TEXT, ends with 0 */
+    const uint8_t *cur_pos = data;
+    uint64_t address = text_vmaddr;
+    while (cur_pos < data + size) {
+        uint64_t delta = read_uleb128(&cur_pos);
+        if (delta == 0)
+            break;
+        address += delta;
+        func_starts->starts[func_starts->nstarts++] = address + vm_slide;
+    }
+    return func_starts;
+}
+
+macho_func_starts_t *parse_function_starts(FILE *fp, const macho_basic_info_t *macho_info, arena_t *arena) {
+    const uint8_t *data = NULL;
+    if (macho_info->funcstarts_off != 0 && macho_info->funcstarts_size != 0)
+        data = read_file_off_arena(arena, fp, macho_info->funcstarts_size, macho_info->base_offset + macho_info->funcstarts_off);
+    return decode_function_starts(data, data != NULL ? macho_info->funcstarts_size : 0,
+                                  macho_info->text_vmaddr, macho_info->vm_slide, macho_info->text_sect_end, arena);
+}
+
+uint32_t function_extent(const macho_func_starts_t *func_starts, uint64_t fileoff) {
+    /* find the first start after fileoff */
+    uint32_t lo = 0, hi = func_starts->nstarts;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (func_starts->starts[mid] <= fileoff)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    uint64_t end = 0;
+    if (lo < func_starts->nstarts)
+        end = func_starts->starts[lo];
+    else if (fileoff < func_starts->text_sect_end)
+        end = func_starts->text_sect_end; /* the last function */
+    if (end == 0 || end - fileoff > UINT32_MAX)
+        return 0;
+    return (uint32_t)(end - fileoff);
+}
+
+const macho_func_starts_t *function_starts(symbol_tables_t *tables) {
+    if (!tables->funcstarts_read) {
+        tables->funcstarts_read = true;
+        fseek(tables->fp, tables->info->base_offset, SEEK_SET);
+        const macho_basic_info_t *basic_info = parse_basic_info(tables->fp, tables->arena);
+        if (basic_info != NULL)
+            tables->func_starts = parse_function_starts(tables->fp, basic_info, tables->arena);
+        else /* no start, so no bound */
+            tables->func_starts = decode_function_starts(NULL, 0, 0, 0, 0, tables->arena);
+    }
+    return tables->func_starts;
+}
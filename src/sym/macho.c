@@ -6,41 +6,116 @@
 #include <string.h>
 #include <mach-o/loader.h>
 
-macho_basic_info_t *parse_basic_info(FILE *fp) {
-    macho_basic_info_t *macho_info = malloc(sizeof(macho_basic_info_t));
-    memset(macho_info, 0, sizeof(macho_basic_info_t));
+/* header and load commands of the slice at fp, NULL if it is not a complete 64-bit Mach-O */
+static const struct load_command *read_load_commands(FILE *fp, arena_t *arena, const struct mach_header_64 **header_out) {
+    const struct mach_header_64 *header = read_file_arena(arena, fp, sizeof(struct mach_header_64));
+    if (header == NULL || header->magic != MH_MAGIC_64)
+        return NULL;
+    const struct load_command *commands = read_file_arena(arena, fp, header->sizeofcmds);
+    *header_out = header;
+    return commands;
+}
+
+/* the smallest cmdsize of the load commands read here */
+static uint32_t min_cmdsize(uint32_t cmd) {
+    switch (cmd) {
+    case LC_SEGMENT_64:
+        return sizeof(struct segment_command_64);
+    case LC_SYMTAB:
+        return sizeof(struct symtab_command);
+    case LC_DYSYMTAB:
+        return sizeof(struct dysymtab_command);
+    case LC_DYLD_INFO:
+    case LC_DYLD_INFO_ONLY:
+        return sizeof(struct dyld_info_command);
+    case LC_FUNCTION_STARTS:
+    case LC_DYLD_EXPORTS_TRIE:
+    case LC_DYLD_CHAINED_FIXUPS:
+        return sizeof(struct linkedit_data_command);
+    case LC_UUID:
+        return sizeof(struct uuid_command);
+    default:
+        return sizeof(struct load_command);
+    }
+}
+
+/* the load command at command if it lies within the load commands, NULL otherwise */
+static const struct load_command *checked_command(const struct mach_header_64 *header, const struct load_command *commands,
+                                                  const struct load_command *command) {
+    const uint8_t *end = (const uint8_t *)commands + header->sizeofcmds;
+    if (end - (const uint8_t *)command < sizeof(struct load_command) ||
+        command->cmdsize < min_cmdsize(command->cmd) || command->cmdsize > end - (const uint8_t *)command)
+        return NULL;
+    return command;
+}
+
+/* number of the sections of a segment that fit in its load command */
+static uint32_t segment_nsects(const struct segment_command_64 *seg_cmd) {
+    if (seg_cmd->cmdsize < sizeof(struct segment_command_64))
+        return 0;
+    uint32_t max_nsects = (seg_cmd->cmdsize - sizeof(struct segment_command_64)) / sizeof(struct section_64);
+    return seg_cmd->nsects < max_nsects ? seg_cmd->nsects : max_nsects;
+}
+
+macho_basic_info_t *parse_basic_info(FILE *fp, arena_t *arena) {
+    macho_basic_info_t *macho_info = arena_calloc(arena, sizeof(macho_basic_info_t));
     macho_info->base_offset = ftell(fp);
 
-    const struct mach_header_64 *header = read_file(fp, sizeof(struct mach_header_64));
-    const struct load_command* commands = read_file(fp, header->sizeofcmds);
+    const struct mach_header_64 *header;
+    const struct load_command* commands = read_load_commands(fp, arena, &header);
+    if (commands == NULL)
+        return NULL;
     const struct load_command* command = commands;
     macho_info->cputype = header->cputype;
-    for (int i = 0; i < header->ncmds; i++) {
-        if (command->cmd == LC_SEGMENT_64) {
+    for (int i = 0; i < header->ncmds && checked_command(header, commands, command) != NULL; i++) {
+        switch(command->cmd) {
+        case LC_SEGMENT_64: {
             const struct segment_command_64 *seg_cmd = (void *)command;
             if (strcmp(seg_cmd->segname, SEG_TEXT) == 0) { /* __TEXT */
                 /* addr_vm - text_vm = addr_file - text_file */
                 macho_info->vm_slide = seg_cmd->fileoff - seg_cmd->vmaddr;
-                break;
+                macho_info->text_vmaddr = seg_cmd->vmaddr;
+
+                const struct section_64 *text_sect = (void *)(seg_cmd + 1);
+                for (int j = 0; j < segment_nsects(seg_cmd); j++) {
+                    if (strncmp(text_sect[j].sectname, SECT_TEXT, 16) == 0) {
+                        macho_info->text_sect_end = text_sect[j].offset + text_sect[j].size;
+                        break;
+                    }
+                }
             }
+            break;
+        }
+        case LC_FUNCTION_STARTS: {
+            const struct linkedit_data_command *func_starts = (void *)command;
+            macho_info->funcstarts_off = func_starts->dataoff;
+            macho_info->funcstarts_size = func_starts->datasize;
+            break;
+        }
+        case LC_UUID: {
+            const struct uuid_command *uuid_cmd = (void *)command;
+            memcpy(macho_info->uuid, uuid_cmd->uuid, sizeof(macho_info->uuid));
+            break;
+        }
+        default:
+            break;
         }
         command = (void*)command + command->cmdsize;
     }
-    free((void *)header);
-    free((void *)commands);
     return macho_info;
 }
 
-macho_symbol_info_t *parse_symbol_info(FILE *fp) {
-    macho_symbol_info_t *macho_info = malloc(sizeof(macho_symbol_info_t));
-    memset(macho_info, 0, sizeof(macho_symbol_info_t));
+macho_symbol_info_t *parse_symbol_info(FILE *fp, arena_t *arena) {
+    macho_symbol_info_t *macho_info = arena_calloc(arena, sizeof(macho_symbol_info_t));
     macho_info->base_offset = ftell(fp);
 
-    const struct mach_header_64 *header = read_file(fp, sizeof(struct mach_header_64));
-    const struct load_command* commands = read_file(fp, header->sizeofcmds);
+    const struct mach_header_64 *header;
+    const struct load_command* commands = read_load_commands(fp, arena, &header);
+    if (commands == NULL)
+        return NULL;
     const struct load_command* command = commands;
     macho_info->cputype = header->cputype;
-    for (int i = 0; i < header->ncmds; i++) {
+    for (int i = 0; i < header->ncmds && checked_command(header, commands, command) != NULL; i++) {
         switch(command->cmd) {
         case LC_SEGMENT_64: {
             const struct segment_command_64 *seg_cmd = (void *)command;
@@ -49,7 +124,7 @@ macho_symbol_info_t *parse_symbol_info(FILE *fp) {
                 macho_info->vm_slide = seg_cmd->fileoff - seg_cmd->vmaddr;
 
                 const struct section_64 *text_sect = (void *)(seg_cmd + 1);
-                for (int j = 0; j < seg_cmd->nsects; j++) {
+                for (int j = 0; j < segment_nsects(seg_cmd); j++) {
                     if ((text_sect[j].flags & SECTION_TYPE) == S_SYMBOL_STUBS) {
                         macho_info->stubs_off = text_sect[j].offset;
                         macho_info->stubs_size = text_sect[j].size;
@@ -87,32 +162,37 @@ macho_symbol_info_t *parse_symbol_info(FILE *fp) {
             macho_info->export_size = export_trie->datasize;
             break;
         }
+        case LC_UUID: {
+            const struct uuid_command *uuid_cmd = (void *)command;
+            memcpy(macho_info->uuid, uuid_cmd->uuid, sizeof(macho_info->uuid));
+            break;
+        }
         default:
             break;
         }
         command = (void*)command + command->cmdsize;
     }
-    free((void *)header);
-    free((void *)commands);
     return macho_info;
 }
 
-macho_objc_info_t *parse_objc_info(FILE *fp) {
-    macho_objc_info_t *macho_info = malloc(sizeof(macho_objc_info_t));
-    memset(macho_info, 0, sizeof(macho_objc_info_t));
+macho_objc_info_t *parse_objc_info(FILE *fp, arena_t *arena) {
+    macho_objc_info_t *macho_info = arena_calloc(arena, sizeof(macho_objc_info_t));
     macho_info->base_offset = ftell(fp);
 
-    const struct mach_header_64 *header = read_file(fp, sizeof(struct mach_header_64));
-    const struct load_command* commands = read_file(fp, header->sizeofcmds);
+    const struct mach_header_64 *header;
+    const struct load_command* commands = read_load_commands(fp, arena, &header);
+    if (commands == NULL)
+        return NULL;
     const struct load_command* command = commands;
     uint64_t dataend = 0;
     macho_info->cputype = header->cputype;
-    for (int i = 0; i < header->ncmds; i++) {
+    for (int i = 0; i < header->ncmds && checked_command(header, commands, command) != NULL; i++) {
         if (command->cmd == LC_SEGMENT_64) {
             const struct segment_command_64 *seg_cmd = (void *)command;
             if (strcmp(seg_cmd->segname, SEG_TEXT) == 0) { /* __TEXT */
                 /* addr_vm - text_vm = addr_file - text_file */
                 macho_info->vm_slide = seg_cmd->fileoff - seg_cmd->vmaddr;
+                macho_info->text_vmaddr = seg_cmd->vmaddr;
                 /* also include __TEXT in the mapped end */
                 if (dataend < seg_cmd->fileoff + seg_cmd->filesize)
                     dataend = seg_cmd->fileoff + seg_cmd->filesize;
@@ -122,19 +202,26 @@ macho_objc_info_t *parse_objc_info(FILE *fp) {
                     dataend = seg_cmd->fileoff + seg_cmd->filesize;
                 
                 const struct section_64 *data_sect = (void *)(seg_cmd + 1);
-                for (int j = 0; j < seg_cmd->nsects; j++) {
+                for (int j = 0; j < segment_nsects(seg_cmd); j++) {
                     if (strncmp(data_sect[j].sectname, "__objc_classlist", 16) == 0) {
                         /* reached max len 16, no '\0' ending */
                         macho_info->objc_classlist_off = data_sect[j].offset;
                         macho_info->objc_classlist_size = data_sect[j].size;
                     }
+                    else if (strncmp(data_sect[j].sectname, "__objc_catlist", 16) == 0) {
+                        macho_info->objc_catlist_off = data_sect[j].offset;
+                        macho_info->objc_catlist_size = data_sect[j].size;
+                    }
                 }
             }
         }
+        else if (command->cmd == LC_DYLD_CHAINED_FIXUPS) {
+            const struct linkedit_data_command *fixups_cmd = (void *)command;
+            macho_info->chained_fixups_off = fixups_cmd->dataoff;
+            macho_info->chained_fixups_size = fixups_cmd->datasize;
+        }
         command = (void*)command + command->cmdsize;
     }
     macho_info->dataend_off = dataend;
-    free((void *)header);
-    free((void *)commands);
     return macho_info;
 }
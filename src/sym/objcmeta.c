@@ -9,7 +9,7 @@
 /* copied from dyld source code */
 
 #define ISA_MASK 0x7fffffffffffULL
-#define FAST_DATA_MASK 0xfffffffcUL
+#define FAST_DATA_MASK 0x7ffffffffff8ULL
 
 struct objc_class_t {
     uint64_t isaVMAddr;
@@ -35,6 +35,15 @@ struct class_ro_t {
     uint64_t basePropertiesVMAddr;
 };
 
+struct category_t {
+    uint64_t nameVMAddr;
+    uint64_t clsVMAddr;
+    uint64_t instanceMethodsVMAddr;
+    uint64_t classMethodsVMAddr;
+    uint64_t protocolsVMAddr;
+    uint64_t instancePropertiesVMAddr;
+};
+
 struct method_list_t {
     uint32_t entsize;
     uint32_t count;
@@ -52,13 +61,13 @@ struct relative_method_t {
     int32_t impOffset;    // IMP
 };
 
-void seperate_method(const char *symbol_name, char **class_name, char **sel_name) {
+static void seperate_method(const char *symbol_name, char **class_name, char **sel_name, arena_t *arena) {
     /* assume this is valid */
     char *split = strchr(symbol_name, ' ');
     size_t cls_len = split - symbol_name - 2; /* remove '-[' */
     size_t sel_len = strlen(symbol_name) - cls_len - 4; /* remove '-[ ]' */
-    char *clsn = malloc(cls_len + 1);
-    char *seln = malloc(sel_len + 1);
+    char *clsn = arena_alloc(arena, cls_len + 1);
+    char *seln = arena_alloc(arena, sel_len + 1);
     strncpy(clsn, symbol_name + 2, cls_len);
     strncpy(seln, split + 1, sel_len);
     clsn[cls_len] = '\0';
@@ -67,63 +76,278 @@ void seperate_method(const char *symbol_name, char **class_name, char **sel_name
     *sel_name = seln;
 }
 
-long solve_objc_symbol(FILE *fp, const macho_objc_info_t *macho_info, const char* symbol_name) {
-    uint64_t symbol_address = 0;
-    const long base_offset = macho_info->base_offset;
-    const uint64_t vm_slide = macho_info->vm_slide;
-
-    if (macho_info->objc_classlist_off == 0) {
-        fprintf(stderr, "symp: missing __objc_classlist section!\n");
+static uint64_t find_method(const objc_image_t *image, uint64_t list_addr, const char *sel_name) {
+    const struct method_list_t *method_list = image->vm_data(image->ctx, list_addr, sizeof(struct method_list_t));
+    if (method_list == NULL)
         return 0;
+    uint32_t entsize = method_list->entsize & 0x0000FFFC; /* methodListSizeMask */
+    uint64_t method_addr = list_addr + sizeof(struct method_list_t);
+    for (int j = 0; j < method_list->count; j++) {
+        uint64_t name_addr = 0, imp_addr = 0;
+        if ((method_list->entsize & 0x80000000) != 0) { /* usesRelativeOffsets */
+            const struct relative_method_t *rel_method = image->vm_data(image->ctx, method_addr, sizeof(struct relative_method_t));
+            if (rel_method == NULL)
+                return 0;
+            if (image->sel_base != 0) /* shared cache, offset to the selector string */
+                name_addr = image->sel_base + rel_method->nameOffset;
+            else /* offset to the selector ref */
+                name_addr = image->vm_ptr(image->ctx, method_addr + offsetof(struct relative_method_t, nameOffset) + rel_method->nameOffset);
+            imp_addr = method_addr + offsetof(struct relative_method_t, impOffset) + rel_method->impOffset;
+        }
+        else {
+            name_addr = image->vm_ptr(image->ctx, method_addr + offsetof(struct method_t, nameVMAddr));
+            imp_addr = image->vm_ptr(image->ctx, method_addr + offsetof(struct method_t, impVMAddr));
+        }
+        const char *method_name = image->vm_data(image->ctx, name_addr, 1);
+        if (method_name != NULL && strcmp(method_name, sel_name) == 0)
+            return imp_addr;
+        method_addr += entsize;
+    }
+    return 0;
+}
+
+/* "_TtC5MyApp7MyClass" -> "MyApp.MyClass", NULL if not a mangled swift class name */
+static char *demangle_swift_class(const char *name, arena_t *arena) {
+    if (strncmp(name, "_TtC", 4) != 0)
+        return NULL;
+    const char *cur_pos = name + 3;
+    int nidents = 1; /* the module, then one 'C' for each (nested) class */
+    while (*cur_pos == 'C')
+        nidents++, cur_pos++;
+    /* "Swift" is no longer than "_TtCs", every length is replaced by a '.' */
+    char *demangled = arena_alloc(arena, strlen(name) + 1);
+    char *out = demangled;
+    if (*cur_pos == 's') {
+        strcpy(out, "Swift");
+        out += 5;
+        cur_pos++;
+        nidents--;
+    }
+    for (int i = 0; i < nidents; i++) {
+        if (*cur_pos < '1' || *cur_pos > '9')
+            return NULL;
+        char *ident;
+        unsigned long len = strtoul(cur_pos, &ident, 10);
+        if (strlen(ident) < len)
+            return NULL;
+        if (out != demangled)
+            *out++ = '.';
+        memcpy(out, ident, len);
+        out += len;
+        cur_pos = ident + len;
+    }
+    *out = '\0';
+    return *cur_pos == '\0' ? demangled : NULL; /* generic or private names are not handled */
+}
+
+/* name of the class (not the metaclass) at cls_addr */
+static const char *class_name_at(const objc_image_t *image, uint64_t cls_addr) {
+    uint64_t data_addr = image->vm_ptr(image->ctx, cls_addr + offsetof(struct objc_class_t, dataVMAddrAndFastFlags)) & FAST_DATA_MASK;
+    uint64_t name_addr = image->vm_ptr(image->ctx, data_addr + offsetof(struct class_ro_t, nameVMAddr));
+    return image->vm_data(image->ctx, name_addr, 1);
+}
+
+/* name of the class a category extends, it is usually bound to another image */
+static const char *category_class_name(const objc_image_t *image, uint64_t cat_addr) {
+    uint64_t cls_ref = cat_addr + offsetof(struct category_t, clsVMAddr);
+    if (image->vm_bind != NULL) {
+        const char *bind_name = image->vm_bind(image->ctx, cls_ref);
+        if (bind_name != NULL)
+            return strncmp(bind_name, "_OBJC_CLASS_$_", 14) == 0 ? bind_name + 14 : NULL;
+    }
+    uint64_t cls_addr = image->vm_ptr(image->ctx, cls_ref);
+    return cls_addr != 0 ? class_name_at(image, cls_addr) : NULL;
+}
+
+/* the method lists of a class or of one of its categories */
+typedef struct {
+    const char *class_name;  /* swift classes are indexed under both names */
+    const char *cat_name;    /* NULL for the class itself */
+    uint64_t instance_methods;
+    uint64_t class_methods;  /* of the metaclass for a class */
+    int32_t next;            /* next entry of the bucket in image order, -1 at the end */
+} objc_entry_t;
+
+struct objc_index {
+    uint32_t nbuckets;
+    uint32_t nentries;
+    int32_t *buckets;        /* first entry, -1 if empty */
+    objc_entry_t entries[];  /* categories first, then classes */
+};
+
+static void add_objc_entry(objc_index_t *index, const char *class_name, const char *cat_name,
+                           uint64_t instance_methods, uint64_t class_methods, arena_t *arena) {
+    objc_entry_t *entry = &index->entries[index->nentries++];
+    entry->class_name = class_name;
+    entry->cat_name = cat_name;
+    entry->instance_methods = instance_methods;
+    entry->class_methods = class_methods;
+    /* "_TtC5MyApp7MyClass" is also looked up as "MyApp.MyClass" */
+    const char *swift_name = demangle_swift_class(class_name, arena);
+    if (swift_name != NULL) {
+        index->entries[index->nentries] = *entry;
+        index->entries[index->nentries++].class_name = swift_name;
+    }
+}
+
+static uint64_t class_methods_at(const objc_image_t *image, uint64_t cls_addr) {
+    uint64_t data_addr = image->vm_ptr(image->ctx, cls_addr + offsetof(struct objc_class_t, dataVMAddrAndFastFlags)) & FAST_DATA_MASK;
+    return image->vm_ptr(image->ctx, data_addr + offsetof(struct class_ro_t, baseMethodsVMAddr));
+}
+
+objc_index_t *build_objc_index(const objc_image_t *image, arena_t *arena) {
+    /* lists out of the image have nothing to index, their sizes are not trusted */
+    uint64_t ncats = image->catlist_size / sizeof(uint64_t);
+    uint64_t nclasses = image->classlist_size / sizeof(uint64_t);
+    if (ncats != 0 && image->vm_data(image->ctx, image->catlist_addr, ncats * sizeof(uint64_t)) == NULL)
+        ncats = 0;
+    if (nclasses != 0 && image->vm_data(image->ctx, image->classlist_addr, nclasses * sizeof(uint64_t)) == NULL)
+        nclasses = 0;
+    objc_index_t *index = arena_alloc(arena, sizeof(objc_index_t) + 2 * (ncats + nclasses) * sizeof(objc_entry_t));
+    index->nentries = 0;
+
+    /* one sweep of the metadata, each name is read and demangled once */
+    for (uint64_t i = 0; i < ncats; i++) {
+        uint64_t cat_addr = image->vm_ptr(image->ctx, image->catlist_addr + i * sizeof(uint64_t));
+        uint64_t cat_name_addr = image->vm_ptr(image->ctx, cat_addr + offsetof(struct category_t, nameVMAddr));
+        const char *cat_name = image->vm_data(image->ctx, cat_name_addr, 1);
+        const char *class_name = category_class_name(image, cat_addr);
+        if (class_name == NULL)
+            continue;
+        add_objc_entry(index, class_name, cat_name != NULL ? cat_name : "",
+                       image->vm_ptr(image->ctx, cat_addr + offsetof(struct category_t, instanceMethodsVMAddr)),
+                       image->vm_ptr(image->ctx, cat_addr + offsetof(struct category_t, classMethodsVMAddr)), arena);
+    }
+    for (uint64_t i = 0; i < nclasses; i++) {
+        uint64_t cls_addr = image->vm_ptr(image->ctx, image->classlist_addr + i * sizeof(uint64_t));
+        const char *class_name = class_name_at(image, cls_addr);
+        if (class_name == NULL)
+            continue;
+        /* class methods are in the metaclass */
+        uint64_t meta_addr = image->vm_ptr(image->ctx, cls_addr + offsetof(struct objc_class_t, isaVMAddr));
+        add_objc_entry(index, class_name, NULL, class_methods_at(image, cls_addr), class_methods_at(image, meta_addr), arena);
     }
 
+    /* chained by class name, built backwards so each chain keeps the image order */
+    index->nbuckets = 16;
+    while (index->nbuckets < index->nentries * 2)
+        index->nbuckets <<= 1;
+    index->buckets = arena_alloc(arena, index->nbuckets * sizeof(int32_t));
+    memset(index->buckets, 0xFF, index->nbuckets * sizeof(int32_t));
+    for (int32_t i = (int32_t)index->nentries - 1; i >= 0; i--) {
+        const uint32_t bucket = hash_update(HASH_INIT, index->entries[i].class_name) & (index->nbuckets - 1);
+        index->entries[i].next = index->buckets[bucket];
+        index->buckets[bucket] = i;
+    }
+    return index;
+}
+
+/* 
+ * '-[Class(Category) sel]' only matches the category,
+ * '-[Class sel]' prefers a category, whose method replaces the class's one at runtime
+ */
+uint64_t solve_objc_image(const objc_image_t *image, const char *symbol_name, arena_t *arena) {
+    const objc_index_t *index = image->index != NULL ? image->index : build_objc_index(image, arena);
     char sym_type = symbol_name[0];
     char *sym_cls, *sym_sel;
-    seperate_method(symbol_name, &sym_cls, &sym_sel);
-
-    const void *macho_data = read_file_off(fp, macho_info->dataend_off, base_offset);
-    #define VM_TO_FILE_OFF(vmaddr) ((uint64_t)((vmaddr) & ISA_MASK) + vm_slide)
-    const uint64_t *classlist = macho_data + macho_info->objc_classlist_off;
-    uint64_t nclasses = macho_info->objc_classlist_size / sizeof(uint64_t);
-    for (int i = 0; i < nclasses; i++) {
-        const struct objc_class_t *objc_cls = macho_data + VM_TO_FILE_OFF(classlist[i]);
-        if (sym_type == '+') /* class method are in metaclass */
-            objc_cls = macho_data + VM_TO_FILE_OFF(objc_cls->isaVMAddr);
-        const struct class_ro_t *class_data = macho_data + (VM_TO_FILE_OFF(objc_cls->dataVMAddrAndFastFlags) & FAST_DATA_MASK);
-        const char *class_name = macho_data + VM_TO_FILE_OFF(class_data->nameVMAddr);
-        if (strcmp(class_name, sym_cls) != 0)
+    seperate_method(symbol_name, &sym_cls, &sym_sel, arena);
+    char *sym_cat = NULL;
+    char *paren = strchr(sym_cls, '(');
+    if (paren != NULL && sym_cls[strlen(sym_cls) - 1] == ')') {
+        *paren = '\0';
+        sym_cat = paren + 1;
+        sym_cat[strlen(sym_cat) - 1] = '\0';
+    }
+
+    const uint32_t bucket = hash_update(HASH_INIT, sym_cls) & (index->nbuckets - 1);
+    for (int32_t i = index->buckets[bucket]; i >= 0; i = index->entries[i].next) {
+        const objc_entry_t *entry = &index->entries[i];
+        if (strcmp(entry->class_name, sym_cls) != 0)
             continue;
-        if ((class_data->baseMethodsVMAddr) != 0) {
-            const struct method_list_t *method_list = macho_data + VM_TO_FILE_OFF(class_data->baseMethodsVMAddr);
-            uint32_t entsize = method_list->entsize & 0x0000FFFC; /* methodListSizeMask */
-            const void *cur_method = (void *)(method_list + 1);
-            for (int j = 0; j < method_list->count; j++) {
-                const char *method_name = NULL;
-                uint64_t method_imp_off = 0;
-                if ((method_list->entsize & 0x80000000) != 0) { /* usesRelativeOffsets */
-                    const struct relative_method_t *rel_method = cur_method;
-                    const uint64_t *method_sel = (void *)rel_method + offsetof(struct relative_method_t, nameOffset) + rel_method->nameOffset;
-                    method_name = macho_data + VM_TO_FILE_OFF(*method_sel);
-                    method_imp_off = (uint64_t)rel_method - (uint64_t)macho_data + offsetof(struct relative_method_t, impOffset) + rel_method->impOffset;
-                }
-                else {
-                    const struct method_t *method = cur_method;
-                    method_name = macho_data + VM_TO_FILE_OFF(method->nameVMAddr);
-                    method_imp_off = VM_TO_FILE_OFF(method->impVMAddr);
-                }
-                if (strcmp(method_name, sym_sel) == 0) {
-                    symbol_address = base_offset + method_imp_off;
-                    break;
-                }
-                cur_method += entsize;
-            }
-            break; /* class name already matched */
-        }
+        if (entry->cat_name == NULL && sym_cat != NULL)
+            break; /* classes follow the categories */
+        if (sym_cat != NULL && strcmp(entry->cat_name, sym_cat) != 0)
+            continue;
+        uint64_t methods_addr = sym_type == '+' ? entry->class_methods : entry->instance_methods;
+        if (methods_addr == 0)
+            continue;
+        uint64_t imp_addr = find_method(image, methods_addr, sym_sel);
+        if (imp_addr != 0 || entry->cat_name == NULL)
+            return imp_addr; /* class name already matched */
+    }
+    return 0;
+}
+
+typedef struct {
+    const uint8_t *macho_data;
+    uint64_t dataend_off;
+    uint64_t vm_slide;
+    const macho_fixups_t *fixups; /* NULL without chained fixups */
+} macho_objc_ctx_t;
+
+static const void *macho_vm_data(const void *ctx, uint64_t vmaddr, size_t len) {
+    const macho_objc_ctx_t *macho = ctx;
+    uint64_t fileoff = vmaddr + macho->vm_slide;
+    if (vmaddr == 0 || fileoff >= macho->dataend_off || macho->dataend_off - fileoff < len)
+        return NULL;
+    return macho->macho_data + fileoff;
+}
+
+static const char *macho_vm_bind(const void *ctx, uint64_t vmaddr) {
+    const macho_objc_ctx_t *macho = ctx;
+    if (macho->fixups == NULL)
+        return NULL;
+    const chained_fixup_t *fixup = find_fixup(macho->fixups, vmaddr);
+    if (fixup == NULL || (fixup->target & FIXUP_BIND) == 0)
+        return NULL;
+    uint64_t ordinal = fixup->target & ~FIXUP_BIND;
+    return ordinal < macho->fixups->nimports ? macho->fixups->import_names[ordinal] : NULL;
+}
+
+static uint64_t macho_vm_ptr(const void *ctx, uint64_t vmaddr) {
+    const macho_objc_ctx_t *macho = ctx;
+    if (macho->fixups != NULL) {
+        /* every pointer is a fixup, binds point out of the image */
+        const chained_fixup_t *fixup = find_fixup(macho->fixups, vmaddr);
+        if (fixup == NULL || (fixup->target & FIXUP_BIND) != 0)
+            return 0;
+        return fixup->target;
+    }
+    const uint64_t *ptr = macho_vm_data(ctx, vmaddr, sizeof(uint64_t));
+    return ptr != NULL ? *ptr & ISA_MASK : 0;
+}
+
+const objc_image_t *objc_image(symbol_tables_t *tables) {
+    if (tables->objc_read)
+        return tables->objc_image;
+    tables->objc_read = true;
+    FILE *fp = tables->fp;
+    arena_t *arena = tables->arena;
+    fseek(fp, tables->info->base_offset, SEEK_SET);
+    const macho_objc_info_t *macho_info = parse_objc_info(fp, arena);
+    if (macho_info == NULL)
+        return NULL;
+    const uint64_t vm_slide = macho_info->vm_slide;
+
+    if (macho_info->objc_classlist_off == 0 && macho_info->objc_catlist_off == 0) {
+        fprintf(stderr, "symp: missing __objc_classlist and __objc_catlist sections!\n");
+        return NULL;
     }
 
-    free(sym_cls);
-    free(sym_sel);
-    free((void *)macho_data);
-    #undef VM_TO_FILE_OFF
-    return (long)symbol_address;
+    macho_objc_ctx_t *macho = arena_calloc(arena, sizeof(macho_objc_ctx_t));
+    macho->dataend_off = macho_info->dataend_off;
+    macho->vm_slide = vm_slide;
+    macho->macho_data = read_file_off_arena(arena, fp, macho_info->dataend_off, macho_info->base_offset);
+    if (macho->macho_data == NULL)
+        return NULL;
+    macho->fixups = parse_chained_fixups(fp, macho_info, macho->macho_data, arena);
+    objc_image_t *image = arena_alloc(arena, sizeof(objc_image_t));
+    *image = (objc_image_t){
+        macho, macho_vm_data, macho_vm_ptr, macho_vm_bind, 0,
+        macho_info->objc_classlist_off - vm_slide, macho_info->objc_classlist_size,
+        macho_info->objc_catlist_off - vm_slide, macho_info->objc_catlist_size, NULL
+    };
+    image->index = build_objc_index(image, arena);
+    tables->objc_image = image;
+    return image;
 }
@@ -3,6 +3,10 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <stdbool.h>
+
+#include "resolve.h"
+#include "../arena.h"
 
 typedef struct {
     int32_t cputype;
@@ -10,6 +14,19 @@ typedef struct {
 
     /* __TEXT vm slide */
     uint64_t vm_slide;
+
+    /* from LC_FUNCTION_STARTS */
+    uint32_t funcstarts_off;
+    uint32_t funcstarts_size;
+
+    /* __TEXT vmaddr, function starts are relative to it */
+    uint64_t text_vmaddr;
+
+    /* end file offset of __TEXT,__text, bounds the last function */
+    uint64_t text_sect_end;
+
+    /* from LC_UUID, all zero if missing */
+    uint8_t uuid[16];
 } macho_basic_info_t;
 
 typedef struct {
@@ -37,6 +54,9 @@ typedef struct {
     uint64_t stubs_size;
     uint32_t indirectsym_idx;
     uint32_t stub_len;
+
+    /* from LC_UUID, all zero if missing */
+    uint8_t uuid[16];
 } macho_symbol_info_t;
 
 typedef struct {
@@ -52,22 +72,182 @@ typedef struct {
     /* objc sections */
     uint32_t objc_classlist_off;
     uint64_t objc_classlist_size;
+    uint32_t objc_catlist_off;
+    uint64_t objc_catlist_size;
+
+    /* __TEXT vmaddr, chained fixups are relative to it */
+    uint64_t text_vmaddr;
+
+    /* from LC_DYLD_CHAINED_FIXUPS */
+    uint32_t chained_fixups_off;
+    uint32_t chained_fixups_size;
 } macho_objc_info_t;
 
+typedef struct {
+    /* end file offset of __TEXT,__text */
+    uint64_t text_sect_end;
+
+    /* sorted function start file offsets from the start of macho file */
+    uint32_t nstarts;
+    uint64_t starts[];
+} macho_func_starts_t;
+
+#define FIXUP_BIND (1ULL << 63)
+
+typedef struct {
+    uint64_t vmaddr;  /* location of the pointer */
+    uint64_t target;  /* vmaddr of a rebase, or FIXUP_BIND | import index */
+} chained_fixup_t;
+
+typedef struct {
+    uint32_t nimports;
+    const char **import_names;
+
+    /* sorted by vmaddr */
+    uint64_t nfixups;
+    chained_fixup_t fixups[];
+} macho_fixups_t;
+
+/* demangled swift names of a slice, defined in swift.c */
+typedef struct swift_index swift_index_t;
+
+typedef struct {
+    uint32_t nbits;
+    uint32_t nhashes;
+    uint8_t bits[];
+} symbol_bloom_t;
+
+/* classes and categories of an objc image by name, defined in objcmeta.c */
+typedef struct objc_index objc_index_t;
+
+/* memory access of an image for the objc walker, addresses are vm addresses */
+typedef struct {
+    const void *ctx;
+    /* pointer to len bytes at vmaddr, NULL if not mapped */
+    const void *(*vm_data)(const void *ctx, uint64_t vmaddr, size_t len);
+    /* target vmaddr of the pointer stored at vmaddr, 0 if unknown */
+    uint64_t (*vm_ptr)(const void *ctx, uint64_t vmaddr);
+    /* symbol name of the bind at vmaddr, NULL if not a bind, the callback may be NULL */
+    const char *(*vm_bind)(const void *ctx, uint64_t vmaddr);
+    /* base of relative method names, 0 if they point to selector refs */
+    uint64_t sel_base;
+
+    uint64_t classlist_addr;
+    uint64_t classlist_size;
+    uint64_t catlist_addr;
+    uint64_t catlist_size;
+
+    /* built once for images searched several times, NULL to build one for each symbol */
+    const objc_index_t *index;
+} objc_image_t;
+
+/* the tables of a slice searched for symbols, each one is read on first use */
+typedef struct {
+    FILE *fp;
+    const macho_symbol_info_t *info;
+    arena_t *arena;
+    const uint8_t *export_trie;
+    const struct nlist_64 *nl_tbl;
+    const char *str_tbl;
+    const uint32_t *stub_entries;
+    const macho_func_starts_t *func_starts;
+    const objc_image_t *objc_image;
+    const swift_index_t *swift_index;
+    bool export_read, symtab_read, stubs_read, funcstarts_read, objc_read, swift_read;
+} symbol_tables_t;
+
+/* 
+ * everything returned below is owned by the arena
+ * and released with it in one call
+ */
+
 /* 
  * defined in macho.c
- * fp -> start of macho file 
+ * fp -> start of macho file
+ * NULL if the header or the load commands can not be read
  */
-macho_basic_info_t *parse_basic_info(FILE *fp);
+macho_basic_info_t *parse_basic_info(FILE *fp, arena_t *arena);
 
-macho_symbol_info_t *parse_symbol_info(FILE *fp);
+macho_symbol_info_t *parse_symbol_info(FILE *fp, arena_t *arena);
 
-macho_objc_info_t *parse_objc_info(FILE *fp);
+macho_objc_info_t *parse_objc_info(FILE *fp, arena_t *arena);
 
 /* defined in symbol.c */
-long solve_symbol(FILE *fp, const macho_symbol_info_t *macho_info, const char* symbol_name);
+uint64_t read_uleb128(const uint8_t **p);
+
+/* return the offset of a regular export from the mach header, 0 if not found */
+uint64_t trie_query(const uint8_t *export, const char *name);
+
+void init_symbol_tables(symbol_tables_t *tables, FILE *fp, const macho_symbol_info_t *macho_info, arena_t *arena);
+
+/* return the file offset of a regular symbol, the tables are kept for the next symbols of the slice */
+long solve_symbol_tables(symbol_tables_t *tables, const char* symbol_name, symsrc_t *source);
 
 /* defined in objcmeta.c */
-long solve_objc_symbol(FILE *fp, const macho_objc_info_t *macho_info, const char* symbol_name);
+/* the objc image of the slice of tables with its fixups, read on first use, NULL if it has no objc metadata */
+const objc_image_t *objc_image(symbol_tables_t *tables);
+
+/* sweep the classlist and catlist of the image once into an index */
+objc_index_t *build_objc_index(const objc_image_t *image, arena_t *arena);
+
+/* return the vmaddr of the method implementation, 0 if not found */
+uint64_t solve_objc_image(const objc_image_t *image, const char *symbol_name, arena_t *arena);
+
+/* defined in bloom.c */
+/* malloc'd path of the cache file of a slice named by its uuid, NULL if it has none */
+char *slice_cache_path(const macho_symbol_info_t *macho_info, const char *ext);
+
+symbol_bloom_t *load_symbol_bloom(FILE *fp, const macho_symbol_info_t *macho_info, arena_t *arena);
+
+bool bloom_maybe_contains(const symbol_bloom_t *bloom, const char *name);
+
+/* defined in funcstarts.c */
+macho_func_starts_t *parse_function_starts(FILE *fp, const macho_basic_info_t *macho_info, arena_t *arena);
+
+/* starts are text_vmaddr + deltas + vm_slide, data may be NULL */
+macho_func_starts_t *decode_function_starts(const uint8_t *data, uint32_t size, uint64_t text_vmaddr, uint64_t vm_slide, uint64_t text_sect_end, arena_t *arena);
+
+/* 
+ * return the max patch length at fileoff (in the same space as the starts),
+ * bounded by the next function start, 0 if unknown
+ */
+uint32_t function_extent(const macho_func_starts_t *func_starts, uint64_t fileoff);
+
+/* the function starts of the slice of tables, decoded on first use */
+const macho_func_starts_t *function_starts(symbol_tables_t *tables);
+
+/* defined in swift.c */
+/* 
+ * the swift symbols of the slice of tables demangled into an index, cached by uuid,
+ * loaded on first use, NULL if they can not be demangled
+ */
+const swift_index_t *swift_index(symbol_tables_t *tables);
+
+/* return the mangled symbol of a demangled swift name, NULL if not found */
+const char *solve_swift_name(const swift_index_t *index, const char *name, arena_t *arena);
+
+/* defined in fixups.c */
+/* 
+ * decode all the chains of LC_DYLD_CHAINED_FIXUPS into one table
+ * macho_data is the slice read up to dataend_off, NULL if the slice has no chained fixups
+ */
+macho_fixups_t *parse_chained_fixups(FILE *fp, const macho_objc_info_t *macho_info, const uint8_t *macho_data, arena_t *arena);
+
+/* the fixup of the pointer at vmaddr, NULL if there is none */
+const chained_fixup_t *find_fixup(const macho_fixups_t *fixups, uint64_t vmaddr);
+
+/* defined in dyldcache.c */
+/* 
+ * return the vmaddr of the symbol in the image named image_name,
+ * or in the first image defining it if image_name is NULL, 0 if not found
+ * maxplen is bounded by the function starts of the image
+ */
+uint64_t solve_cache_symbol(const dyld_cache_t *cache, const char *image_name, const char *symbol_name, bool objc, symsrc_t *source, uint32_t *maxplen, arena_t *arena);
+
+/* max patch length at vmaddr, bounded by the function starts of the image whose __text holds it, 0 if none does */
+uint32_t cache_address_extent(const dyld_cache_t *cache, uint64_t vmaddr, arena_t *arena);
+
+/* return the offset of vmaddr in the cache file at *path, -1 if not mapped */
+long cache_vm_to_file(const dyld_cache_t *cache, uint64_t vmaddr, const char **path);
 
 #endif
\ No newline at end of file
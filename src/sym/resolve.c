@@ -4,12 +4,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include <stdbool.h>
 
 typedef enum {
-    HEX_OFFSET, REGULAR_SYMBOL, OBJC_SYMBOL
+    HEX_OFFSET, REGULAR_SYMBOL, OBJC_SYMBOL, SWIFT_SYMBOL
 } symtype_t;
 
+#define SWIFT_PREFIX "swift:"
+
 /* convert a VALID uint64 hex str to num */
 static uint64_t str2uint64(const char* str) {
     int i = 1;
@@ -28,6 +31,8 @@ static uint64_t str2uint64(const char* str) {
 
 static symtype_t determine_type(const char *symbol_name) {
     size_t len = strlen(symbol_name);
+    if (strncmp(symbol_name, SWIFT_PREFIX, strlen(SWIFT_PREFIX)) == 0)
+        return SWIFT_SYMBOL;
     if (symbol_name[0] == '0' &&
         (symbol_name[1] == 'x' || symbol_name[1] == 'X')) {
         int i = 1;
@@ -57,43 +62,166 @@ static symtype_t determine_type(const char *symbol_name) {
     return REGULAR_SYMBOL;
 }
 
-bool lookup_symbol_macho(FILE *fp, const char *symbol_name, patch_off_t *poffout) {
-    bool found = false;
-    int32_t cputype = 0;
+/* 
+ * (g)lobals
+ * all the parse state of a slice lives here and is dropped after each lookup,
+ * the capacity is kept so repeated lookups do not allocate
+ */
+static _Thread_local arena_t g_arena = ARENA_INIT;
+
+/* resolve a symbol of any kind in the slice of tables, which are kept for the next symbols */
+static bool lookup_symbol_tables(symbol_tables_t *tables, const char *symbol_name, patch_off_t *poffout) {
+    const macho_symbol_info_t *symbol_info = tables->info;
+    const long base_offset = symbol_info->base_offset;
     uint32_t max_patch_len = 0;
     long symbol_address = 0;
+    symsrc_t source = SOURCE_ADDRESS;
+    const symtype_t symbol_type = determine_type(symbol_name);
 
-    switch(determine_type(symbol_name)) {
-    case HEX_OFFSET: {
-        const macho_basic_info_t *basic_info = parse_basic_info(fp);
-        cputype = basic_info->cputype;
-        symbol_address = str2uint64(symbol_name) + basic_info->base_offset + basic_info->vm_slide;
-        free((void *)basic_info);
+    switch(symbol_type) {
+    case HEX_OFFSET:
+        symbol_address = str2uint64(symbol_name) + base_offset + symbol_info->vm_slide;
         break;
-    }
-    case REGULAR_SYMBOL: {
-        const macho_symbol_info_t *symbol_info = parse_symbol_info(fp);
-        cputype = symbol_info->cputype;
-        max_patch_len = symbol_info->stub_len;
-        symbol_address = solve_symbol(fp, symbol_info, symbol_name);
-        free((void *)symbol_info);
+    case REGULAR_SYMBOL:
+    case SWIFT_SYMBOL: {
+        const char *name = symbol_name;
+        if (symbol_type == SWIFT_SYMBOL) {
+            const swift_index_t *index = swift_index(tables);
+            name = index != NULL ? solve_swift_name(index, symbol_name + strlen(SWIFT_PREFIX), tables->arena) : NULL;
+        }
+        if (name != NULL)
+            symbol_address = solve_symbol_tables(tables, name, &source);
+        if (source == SOURCE_STUB)
+            max_patch_len = symbol_info->stub_len;
         break;
     }
     case OBJC_SYMBOL: {
-        const macho_objc_info_t *objc_info = parse_objc_info(fp);
-        cputype = objc_info->cputype;
-        symbol_address = solve_objc_symbol(fp, objc_info, symbol_name);
-        free((void *)objc_info);
+        const objc_image_t *image = objc_image(tables);
+        const uint64_t imp_addr = image != NULL ? solve_objc_image(image, symbol_name, tables->arena) : 0;
+        if (imp_addr != 0)
+            symbol_address = base_offset + imp_addr + symbol_info->vm_slide;
+        source = SOURCE_OBJC;
         break;
     }
     default:
         break;
     }
-    if (symbol_address != 0) {
-        found = true;
-        poffout->cputype = cputype;
-        poffout->fileoff = symbol_address;
-        poffout->maxplen = max_patch_len;
+    if (symbol_address == 0)
+        return false;
+    /* stubs are bounded by stub_len already, the rest by the next function start */
+    if (max_patch_len == 0)
+        max_patch_len = function_extent(function_starts(tables), symbol_address - base_offset);
+    poffout->cputype = symbol_info->cputype;
+    poffout->fileoff = symbol_address;
+    poffout->vmaddr = symbol_address - base_offset - symbol_info->vm_slide;
+    poffout->maxplen = max_patch_len;
+    poffout->source = source;
+    poffout->path = NULL;
+    return true;
+}
+
+bool lookup_symbol_macho(FILE *fp, const char *symbol_name, patch_off_t *poffout) {
+    bool found = false;
+    const macho_symbol_info_t *symbol_info = parse_symbol_info(fp, &g_arena);
+    if (symbol_info != NULL) {
+        symbol_tables_t tables;
+        init_symbol_tables(&tables, fp, symbol_info, &g_arena);
+        found = lookup_symbol_tables(&tables, symbol_name, poffout);
     }
+    arena_reset(&g_arena);
     return found;
 }
+
+int lookup_symbols_macho(FILE *fp, char *const *symbol_names, int nsymbols, patch_off_t *poffs, bool *found) {
+    symbol_tables_t tables;
+    const macho_symbol_info_t *symbol_info = parse_symbol_info(fp, &g_arena);
+    if (symbol_info != NULL)
+        init_symbol_tables(&tables, fp, symbol_info, &g_arena);
+    int nfound = 0;
+    for (int i = 0; i < nsymbols; i++) {
+        found[i] = symbol_info != NULL && lookup_symbol_tables(&tables, symbol_names[i], &poffs[i]);
+        nfound += found[i];
+    }
+    arena_reset(&g_arena);
+    return nfound;
+}
+
+bool lookup_symbol_dyld_cache(dyld_cache_t *cache, const char *image_name, const char *symbol_name, patch_off_t *poffout) {
+    uint64_t vmaddr = 0;
+    uint32_t max_patch_len = 0;
+    symsrc_t source = SOURCE_ADDRESS;
+
+    switch(determine_type(symbol_name)) {
+    case HEX_OFFSET:
+        /* a vm address in the cache */
+        vmaddr = str2uint64(symbol_name);
+        max_patch_len = cache_address_extent(cache, vmaddr, &g_arena);
+        break;
+    case REGULAR_SYMBOL:
+        vmaddr = solve_cache_symbol(cache, image_name, symbol_name, false, &source, &max_patch_len, &g_arena);
+        break;
+    case OBJC_SYMBOL:
+        vmaddr = solve_cache_symbol(cache, image_name, symbol_name, true, &source, &max_patch_len, &g_arena);
+        break;
+    case SWIFT_SYMBOL:
+        fprintf(stderr, "symp: swift symbols are not supported in dyld shared caches, use the mangled name\n");
+        break;
+    default:
+        break;
+    }
+    arena_reset(&g_arena);
+    if (vmaddr == 0)
+        return false;
+
+    const char *path;
+    long fileoff = cache_vm_to_file(cache, vmaddr, &path);
+    if (fileoff < 0) {
+        fprintf(stderr, "symp: 0x%llx is not mapped in the dyld shared cache\n", (unsigned long long)vmaddr);
+        return false;
+    }
+    poffout->cputype = dyld_cache_cputype(cache);
+    poffout->fileoff = fileoff;
+    poffout->vmaddr = vmaddr;
+    poffout->maxplen = max_patch_len;
+    poffout->source = source;
+    poffout->path = path;
+    return true;
+}
+
+bool maybe_defines_symbol_macho(FILE *fp, const char *symbol_name) {
+    /* only regular symbols are indexed */
+    if (determine_type(symbol_name) != REGULAR_SYMBOL)
+        return true;
+    const macho_symbol_info_t *symbol_info = parse_symbol_info(fp, &g_arena);
+    if (symbol_info == NULL) {
+        arena_reset(&g_arena);
+        return false; /* no symbol can be looked up in it either */
+    }
+    const symbol_bloom_t *bloom = load_symbol_bloom(fp, symbol_info, &g_arena);
+    bool maybe = bloom == NULL || bloom_maybe_contains(bloom, symbol_name);
+    arena_reset(&g_arena);
+    return maybe;
+}
+
+bool symbol_bloom_cached(const uint8_t *uuid, int32_t cputype) {
+    macho_symbol_info_t symbol_info = {0};
+    symbol_info.cputype = cputype;
+    memcpy(symbol_info.uuid, uuid, sizeof(symbol_info.uuid));
+    char *cache_path = slice_cache_path(&symbol_info, "bloom");
+    bool cached = cache_path != NULL && access(cache_path, R_OK) == 0;
+    free(cache_path);
+    return cached;
+}
+
+void lookup_uuid_macho(FILE *fp, uint8_t *uuid) {
+    const macho_basic_info_t *basic_info = parse_basic_info(fp, &g_arena);
+    if (basic_info != NULL)
+        memcpy(uuid, basic_info->uuid, sizeof(basic_info->uuid));
+    else
+        memset(uuid, 0, sizeof(basic_info->uuid));
+    arena_reset(&g_arena);
+}
+
+void release_lookup_state(void) {
+    arena_release(&g_arena);
+}
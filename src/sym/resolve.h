@@ -2,14 +2,24 @@
 #define SYMSOLVE_H
 
 #include <stdio.h>
+#include <stdint.h>
 #include <stdbool.h>
 
+typedef enum {
+    SOURCE_ADDRESS, SOURCE_EXPORT, SOURCE_STUB, SOURCE_SYMTAB, SOURCE_OBJC
+} symsrc_t;
+
 typedef struct {
     int cputype;
-    int maxplen;  /* max patch lenth */
+    uint32_t maxplen;  /* max patch lenth, 0 if unknown */
     long fileoff;
+    uint64_t vmaddr;  /* unslid address of fileoff, branches of compiled patches are relative to it */
+    symsrc_t source; /* where the symbol was found */
+    const char *path; /* file of fileoff if not the one looked up, e.g. a subcache */
 } patch_off_t;
 
+typedef struct dyld_cache dyld_cache_t;
+
 /* 
  * return true if found
  * update fileoff and maxplen of the patch_off_t
@@ -17,4 +27,47 @@ typedef struct {
  */
 bool lookup_symbol_macho(FILE *fp, const char *symbol_name, patch_off_t *poffout);
 
+/* 
+ * look up all the symbols of a slice at once, its tables are read once
+ * set found[i] and poffs[i] of each symbol, return the number found
+ * fp -> start of macho file
+ */
+int lookup_symbols_macho(FILE *fp, char *const *symbol_names, int nsymbols, patch_off_t *poffs, bool *found);
+
+/* 
+ * return false if the symbol is surely not defined in the macho file,
+ * using a cached bloom filter over export trie and symtab names
+ * fp -> start of macho file
+ */
+bool maybe_defines_symbol_macho(FILE *fp, const char *symbol_name);
+
+/* true if the bloom filter of the slice with uuid is in the cache directory */
+bool symbol_bloom_cached(const uint8_t *uuid, int32_t cputype);
+
+/* 
+ * copy the 16 bytes LC_UUID to uuid, all zero if missing
+ * fp -> start of macho file
+ */
+void lookup_uuid_macho(FILE *fp, uint8_t *uuid);
+
+/* 
+ * map a dyld shared cache with its subcaches and .symbols file
+ * return NULL if path is not a dyld shared cache
+ */
+dyld_cache_t *open_dyld_cache(const char *path);
+
+void close_dyld_cache(dyld_cache_t *cache);
+
+int32_t dyld_cache_cputype(const dyld_cache_t *cache);
+
+/* 
+ * return true if found
+ * look up in the image with the install name (or its file name) image_name,
+ * in all images if NULL, path of poffout is set to the cache file of fileoff
+ */
+bool lookup_symbol_dyld_cache(dyld_cache_t *cache, const char *image_name, const char *symbol_name, patch_off_t *poffout);
+
+/* release the memory kept between lookups of this thread */
+void release_lookup_state(void);
+
 #endif
\ No newline at end of file
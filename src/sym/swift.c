@@ -0,0 +1,274 @@
+#include "private.h"
+#include "../fileio.h"
+
+#include <dlfcn.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <mach-o/nlist.h>
+
+#define SWIFT_INDEX_MAGIC 0x3158495753504d53ULL /* "SMPSWIX1" */
+#define SWIFT_NAME_MAX 4096
+#define TRIE_MAX_DEPTH 1024
+
+/* exported by the swift runtime, returns a malloc'd string if out is NULL */
+typedef char *(*swift_demangle_fn)(const char *mangled, size_t len, char *out, size_t *out_len, uint32_t flags);
+
+/*
+ * the index is kept in memory as it is on disk:
+ * header, uint32_t buckets[nbuckets] (string offset + 1, 0 if empty),
+ * then the strings, "normalized\0mangled\0" for each name
+ */
+struct swift_index {
+    uint64_t magic;
+    uint32_t nbuckets;
+    uint32_t strings_size;
+};
+
+typedef struct {
+    size_t count, cap;
+    char **normalized;
+    char **mangled;
+    size_t strings_size;
+    swift_demangle_fn demangle;
+    arena_t *arena;
+} swift_names_t;
+
+static swift_demangle_fn load_swift_demangle(void) {
+    static const char *libs[] = {
+        "/usr/lib/swift/libswiftCore.dylib", "libswiftCore.dylib", "libswiftCore.so"
+    };
+    for (int i = 0; i < sizeof(libs) / sizeof(libs[0]); i++) {
+        void *handle = dlopen(libs[i], RTLD_LAZY | RTLD_LOCAL);
+        if (handle == NULL)
+            continue;
+        swift_demangle_fn demangle = (swift_demangle_fn)dlsym(handle, "swift_demangle");
+        if (demangle != NULL)
+            return demangle;
+        dlclose(handle);
+    }
+    return NULL;
+}
+
+static bool is_ident_char(char c) {
+    return (c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c == '_' || c == '.';
+}
+
+/* drop spaces and the module of standard types, so "-> Bool" matches "-> Swift.Bool" */
+static char *normalize_swift_name(const char *name, arena_t *arena) {
+    char *normalized = arena_alloc(arena, strlen(name) + 1);
+    char *out = normalized;
+    for (const char *cur_pos = name; *cur_pos; ) {
+        if (*cur_pos == ' ') {
+            cur_pos++;
+            continue;
+        }
+        if (strncmp(cur_pos, "Swift.", 6) == 0 && (cur_pos == name || !is_ident_char(cur_pos[-1]))) {
+            cur_pos += 6;
+            continue;
+        }
+        *out++ = *cur_pos++;
+    }
+    *out = '\0';
+    return normalized;
+}
+
+/* could name_len bytes of name be the start of a swift symbol */
+static bool maybe_swift_prefix(const char *name, size_t name_len) {
+    static const char *prefixes[] = {"_$s", "_$S", "_T0"};
+    size_t len = name_len < 3 ? name_len : 3;
+    for (int i = 0; i < sizeof(prefixes) / sizeof(prefixes[0]); i++) {
+        if (strncmp(name, prefixes[i], len) == 0)
+            return true;
+    }
+    return false;
+}
+
+static void add_swift_name(swift_names_t *names, const char *mangled) {
+    if (names->count == names->cap) {
+        names->cap = names->cap ? names->cap * 2 : 256;
+        names->mangled = realloc(names->mangled, names->cap * sizeof(char *));
+    }
+    size_t mangled_len = strlen(mangled) + 1;
+    char *mangled_copy = arena_alloc(names->arena, mangled_len);
+    memcpy(mangled_copy, mangled, mangled_len);
+    names->mangled[names->count++] = mangled_copy;
+}
+
+static int cmp_name(const void *a, const void *b) {
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/* demangle every distinct name once, names in both export trie and symtab are dropped */
+static void demangle_swift_names(swift_names_t *names) {
+    qsort(names->mangled, names->count, sizeof(char *), cmp_name);
+    names->normalized = malloc((names->count ? names->count : 1) * sizeof(char *));
+    size_t ndemangled = 0;
+    for (size_t i = 0; i < names->count; i++) {
+        const char *mangled = names->mangled[i];
+        if (i != 0 && strcmp(mangled, names->mangled[i - 1]) == 0)
+            continue;
+        /* drop the leading '_' of the C symbol */
+        char *demangled = names->demangle(mangled + 1, strlen(mangled + 1), NULL, NULL, 0);
+        if (demangled == NULL)
+            continue;
+        names->normalized[ndemangled] = normalize_swift_name(demangled, names->arena);
+        names->mangled[ndemangled] = names->mangled[i];
+        names->strings_size += strlen(names->normalized[ndemangled]) + 1 + strlen(mangled) + 1;
+        ndemangled++;
+        free(demangled);
+    }
+    names->count = ndemangled;
+}
+
+/* build the names on the way down, only into subtrees that can be swift symbols */
+static void collect_swift_trie(const uint8_t *export, uint32_t export_size, uint64_t node_off,
+                               char *name, size_t name_len, int depth, swift_names_t *names) {
+    if (node_off >= export_size || depth > TRIE_MAX_DEPTH || !maybe_swift_prefix(name, name_len))
+        return;
+    const uint8_t *cur_pos = export + node_off;
+    uint64_t info_len = read_uleb128(&cur_pos);
+    if (info_len != 0 && name_len >= 3)
+        add_swift_name(names, name);
+    cur_pos += info_len;
+    if (cur_pos >= export + export_size)
+        return;
+    uint8_t child_count = *cur_pos++;
+    for (int i = 0; i < child_count; i++) {
+        const char *edge = (const char *)cur_pos;
+        size_t edge_len = strnlen(edge, export + export_size - cur_pos);
+        cur_pos += edge_len + 1;
+        if (cur_pos >= export + export_size)
+            return;
+        uint64_t next_off = read_uleb128(&cur_pos);
+        if (name_len + edge_len >= SWIFT_NAME_MAX)
+            continue;
+        memcpy(name + name_len, edge, edge_len);
+        name[name_len + edge_len] = '\0';
+        collect_swift_trie(export, export_size, next_off, name, name_len + edge_len, depth + 1, names);
+    }
+    name[name_len] = '\0';
+}
+
+static const char *index_lookup(const swift_index_t *index, const char *normalized) {
+    const uint32_t *buckets = (const void *)(index + 1);
+    const char *strings = (const char *)(buckets + index->nbuckets);
+    const uint32_t mask = index->nbuckets - 1;
+    for (uint32_t i = hash_update(HASH_INIT, normalized) & mask; buckets[i] != 0; i = (i + 1) & mask) {
+        if (buckets[i] - 1 >= index->strings_size)
+            return NULL; /* corrupted */
+        const char *entry = strings + buckets[i] - 1;
+        size_t entry_len = strnlen(entry, strings + index->strings_size - entry);
+        if (entry + entry_len + 1 >= strings + index->strings_size)
+            return NULL;
+        if (strcmp(entry, normalized) == 0)
+            return entry + entry_len + 1;
+    }
+    return NULL;
+}
+
+static size_t index_size(const swift_index_t *index) {
+    return sizeof(swift_index_t) + index->nbuckets * sizeof(uint32_t) + index->strings_size;
+}
+
+static swift_index_t *build_swift_index(FILE *fp, const macho_symbol_info_t *macho_info, arena_t *arena) {
+    const long base_offset = macho_info->base_offset;
+    swift_names_t names = {0};
+    names.arena = arena;
+    names.demangle = load_swift_demangle();
+    if (names.demangle == NULL) {
+        fprintf(stderr, "symp: swift runtime (libswiftCore) not found, can not demangle swift symbols\n");
+        return NULL;
+    }
+
+    if (macho_info->export_off != 0) {
+        uint8_t *export_trie = read_file_off_arena(arena, fp, macho_info->export_size, base_offset + macho_info->export_off);
+        char *name = arena_calloc(arena, SWIFT_NAME_MAX);
+        if (export_trie != NULL)
+            collect_swift_trie(export_trie, macho_info->export_size, 0, name, 0, 0, &names);
+    }
+
+    if (macho_info->symoff != 0) {
+        /* same names as the symtab search in solve_symbol_tables */
+        const struct nlist_64* nl_tbl = read_file_off_arena(arena, fp, macho_info->nsyms * sizeof(struct nlist_64), base_offset + macho_info->symoff);
+        const char* str_tbl = read_file_off_arena(arena, fp, macho_info->strsize, base_offset + macho_info->stroff);
+        if (nl_tbl != NULL && str_tbl != NULL) {
+            for (int i = 0; i < macho_info->nsyms; i++) {
+                if ((nl_tbl[i].n_type & N_TYPE) != N_SECT || nl_tbl[i].n_un.n_strx >= macho_info->strsize)
+                    continue;
+                const char *name = str_tbl + nl_tbl[i].n_un.n_strx;
+                if (strnlen(name, 3) == 3 && maybe_swift_prefix(name, 3))
+                    add_swift_name(&names, name);
+            }
+        }
+    }
+
+    demangle_swift_names(&names);
+
+    /* open addressing, at most half full */
+    uint32_t nbuckets = 16;
+    while (nbuckets < names.count * 2)
+        nbuckets <<= 1;
+    swift_index_t *index = arena_calloc(arena, sizeof(swift_index_t) + nbuckets * sizeof(uint32_t) + names.strings_size);
+    index->magic = SWIFT_INDEX_MAGIC;
+    index->nbuckets = nbuckets;
+    uint32_t *buckets = (void *)(index + 1);
+    char *strings = (char *)(buckets + nbuckets);
+    for (size_t i = 0; i < names.count; i++) {
+        if (index_lookup(index, names.normalized[i]) != NULL)
+            continue; /* overloads demangled to the same name, keep the first */
+        uint32_t bucket = hash_update(HASH_INIT, names.normalized[i]) & (nbuckets - 1);
+        while (buckets[bucket] != 0)
+            bucket = (bucket + 1) & (nbuckets - 1);
+        buckets[bucket] = index->strings_size + 1;
+        size_t len = strlen(names.normalized[i]) + 1;
+        memcpy(strings + index->strings_size, names.normalized[i], len);
+        index->strings_size += len;
+        len = strlen(names.mangled[i]) + 1;
+        memcpy(strings + index->strings_size, names.mangled[i], len);
+        index->strings_size += len;
+    }
+    free(names.normalized);
+    free(names.mangled);
+    return index;
+}
+
+static swift_index_t *read_swift_index(const char *path, arena_t *arena) {
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+        return NULL;
+    swift_index_t *index = NULL;
+    swift_index_t header;
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if (fread(&header, sizeof(header), 1, fp) == 1 && header.magic == SWIFT_INDEX_MAGIC &&
+        header.nbuckets != 0 && (header.nbuckets & (header.nbuckets - 1)) == 0 &&
+        size == index_size(&header))
+        index = read_file_off_arena(arena, fp, size, 0);
+    fclose(fp);
+    return index;
+}
+
+const swift_index_t *swift_index(symbol_tables_t *tables) {
+    if (tables->swift_read)
+        return tables->swift_index;
+    tables->swift_read = true;
+    char *cache_path = slice_cache_path(tables->info, "swiftidx");
+    swift_index_t *index = NULL;
+    if (cache_path != NULL)
+        index = read_swift_index(cache_path, tables->arena);
+    if (index == NULL) {
+        index = build_swift_index(tables->fp, tables->info, tables->arena);
+        if (index != NULL && cache_path != NULL)
+            write_file_atomic(cache_path, index, index_size(index)); /* cache is optional */
+    }
+    free(cache_path);
+    tables->swift_index = index;
+    return index;
+}
+
+const char *solve_swift_name(const swift_index_t *index, const char *name, arena_t *arena) {
+    return index_lookup(index, normalize_swift_name(name, arena));
+}
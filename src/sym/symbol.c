@@ -4,11 +4,14 @@
 #include <string.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 #include <mach-o/nlist.h>
 #include <mach-o/loader.h>
 
-static uint64_t read_uleb128(const uint8_t **p) {
+uint64_t read_uleb128(const uint8_t **p) {
     int bit = 0;
     uint64_t result = 0;
     do {
@@ -19,7 +22,7 @@ static uint64_t read_uleb128(const uint8_t **p) {
     return result;
 }
 
-static uint64_t trie_query(const uint8_t *export, const char *name) {
+uint64_t trie_query(const uint8_t *export, const char *name) {
     // documents in <mach-o/loader.h>
     uint64_t symbol_address = 0;
     uint64_t node_off = 0;
@@ -60,61 +63,207 @@ static uint64_t trie_query(const uint8_t *export, const char *name) {
     return symbol_address;
 }
 
-long solve_symbol(FILE *fp, const macho_symbol_info_t *macho_info, const char* symbol_name) {
+#define SCAN_MIN_SYMS_PER_THREAD (1 << 16)
+#define SCAN_MAX_THREADS 64
+#define SCAN_CHECK_INTERVAL 4096  /* entries between checks for an earlier match */
+
+typedef struct {
+    const struct nlist_64 *nl_tbl;
+    const char *str_tbl;
+    uint32_t strsize;
+    const char *name;
+    size_t name_len;
+    uint32_t head, head_mask;  /* first bytes of name, compared before the whole string */
+    atomic_uint_fast32_t found;  /* lowest matching index so far, nsyms if none */
+} symtab_scan_t;
+
+typedef struct {
+    symtab_scan_t *scan;
+    uint32_t lo, hi;
+} scan_range_t;
+
+static void init_symtab_scan(symtab_scan_t *scan, const macho_symbol_info_t *macho_info,
+                             const struct nlist_64 *nl_tbl, const char *str_tbl, const char *name) {
+    scan->nl_tbl = nl_tbl;
+    scan->str_tbl = str_tbl;
+    scan->strsize = macho_info->strsize;
+    scan->name = name;
+    scan->name_len = strlen(name);
+    /* the name with its NUL, so the word also tells short names apart */
+    size_t head_len = scan->name_len + 1 < sizeof(uint32_t) ? scan->name_len + 1 : sizeof(uint32_t);
+    scan->head = 0;
+    memcpy(&scan->head, name, head_len);
+    scan->head_mask = head_len == sizeof(uint32_t) ? UINT32_MAX : (1U << (head_len * 8)) - 1;
+    atomic_init(&scan->found, macho_info->nsyms);
+}
+
+/* same as strcmp(name, str_tbl + strx) == 0, but bounded and checking the length and first bytes first */
+static bool match_name(const symtab_scan_t *scan, uint32_t strx) {
+    if (strx >= scan->strsize || scan->strsize - strx <= scan->name_len)
+        return false;
+    const char *str = scan->str_tbl + strx;
+    uint32_t word;
+    if (scan->strsize - strx >= sizeof(word)) {
+        memcpy(&word, str, sizeof(word));
+        if ((word & scan->head_mask) != scan->head)
+            return false;
+    }
+    return memcmp(str, scan->name, scan->name_len + 1) == 0;
+}
+
+static void scan_symtab_range(symtab_scan_t *scan, uint32_t lo, uint32_t hi) {
+    for (uint32_t chunk = lo; chunk < hi; chunk += SCAN_CHECK_INTERVAL) {
+        /* a match before chunk wins over anything left in this range */
+        if (atomic_load_explicit(&scan->found, memory_order_relaxed) <= chunk)
+            return;
+        const uint32_t chunk_end = hi - chunk > SCAN_CHECK_INTERVAL ? chunk + SCAN_CHECK_INTERVAL : hi;
+        for (uint32_t i = chunk; i < chunk_end; i++) {
+            if ((scan->nl_tbl[i].n_type & N_TYPE) != N_SECT || !match_name(scan, scan->nl_tbl[i].n_un.n_strx))
+                continue;
+            uint_fast32_t found = atomic_load(&scan->found);
+            while (i < found && !atomic_compare_exchange_weak(&scan->found, &found, i))
+                ;
+            return;
+        }
+    }
+}
+
+static void *scan_symtab_worker(void *arg) {
+    scan_range_t *range = arg;
+    scan_symtab_range(range->scan, range->lo, range->hi);
+    return NULL;
+}
+
+/* 
+ * index of the first defined symbol named name, nsyms if none
+ * large tables are split into ranges across threads, the lowest index still wins
+ */
+static uint32_t scan_symtab(symtab_scan_t *scan, uint32_t nsyms) {
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (ncpus < 1) /* -1 if unknown */
+        ncpus = 1;
+    uint32_t nthreads = nsyms / SCAN_MIN_SYMS_PER_THREAD;
+    if ((long)nthreads > ncpus)
+        nthreads = (uint32_t)ncpus;
+    if (nthreads > SCAN_MAX_THREADS)
+        nthreads = SCAN_MAX_THREADS;
+    if (nthreads <= 1) {
+        scan_symtab_range(scan, 0, nsyms);
+        return atomic_load(&scan->found);
+    }
+
+    pthread_t threads[SCAN_MAX_THREADS];
+    scan_range_t ranges[SCAN_MAX_THREADS];
+    uint32_t nstarted = 0;
+    const uint32_t per_thread = (nsyms + nthreads - 1) / nthreads;
+    /* this thread takes the first range */
+    for (uint32_t i = 1; i < nthreads; i++) {
+        ranges[i] = (scan_range_t){scan, i * per_thread, (i + 1) * per_thread < nsyms ? (i + 1) * per_thread : nsyms};
+        if (pthread_create(&threads[i], NULL, scan_symtab_worker, &ranges[i]) != 0)
+            break;
+        nstarted = i;
+    }
+    scan_symtab_range(scan, 0, per_thread);
+    for (uint32_t i = 1; i <= nstarted; i++)
+        pthread_join(threads[i], NULL);
+    /* ranges not started, scanned here if nothing before them matched */
+    if (nstarted + 1 < nthreads)
+        scan_symtab_range(scan, (nstarted + 1) * per_thread, nsyms);
+    return atomic_load(&scan->found);
+}
+
+void init_symbol_tables(symbol_tables_t *tables, FILE *fp, const macho_symbol_info_t *macho_info, arena_t *arena) {
+    memset(tables, 0, sizeof(symbol_tables_t));
+    tables->fp = fp;
+    tables->info = macho_info;
+    tables->arena = arena;
+}
+
+static const uint8_t *export_trie(symbol_tables_t *tables) {
+    const macho_symbol_info_t *macho_info = tables->info;
+    if (!tables->export_read) {
+        tables->export_read = true;
+        if (macho_info->export_off != 0)
+            tables->export_trie = read_file_off_arena(tables->arena, tables->fp, macho_info->export_size, macho_info->base_offset + macho_info->export_off);
+    }
+    return tables->export_trie;
+}
+
+/* these tables are both needed for symtab search and symbol stubs search */
+static bool read_symtab(symbol_tables_t *tables) {
+    const macho_symbol_info_t *macho_info = tables->info;
+    if (!tables->symtab_read) {
+        tables->symtab_read = true;
+        tables->nl_tbl = read_file_off_arena(tables->arena, tables->fp, macho_info->nsyms * sizeof(struct nlist_64), macho_info->base_offset + macho_info->symoff);
+        tables->str_tbl = read_file_off_arena(tables->arena, tables->fp, macho_info->strsize, macho_info->base_offset + macho_info->stroff);
+    }
+    return tables->nl_tbl != NULL && tables->str_tbl != NULL;
+}
+
+static const uint32_t *stub_entries(symbol_tables_t *tables) {
+    const macho_symbol_info_t *macho_info = tables->info;
+    if (!tables->stubs_read) {
+        tables->stubs_read = true;
+        uint32_t entry_off = macho_info->indirectsymoff + macho_info->indirectsym_idx * sizeof(uint32_t);
+        uint64_t nstubs = macho_info->stubs_size / macho_info->stub_len;
+        tables->stub_entries = read_file_off_arena(tables->arena, tables->fp, nstubs * sizeof(uint32_t), macho_info->base_offset + entry_off);
+    }
+    return tables->stub_entries;
+}
+
+long solve_symbol_tables(symbol_tables_t *tables, const char* symbol_name, symsrc_t *source) {
+    const macho_symbol_info_t *macho_info = tables->info;
     uint64_t symbol_address = 0;
     const long base_offset = macho_info->base_offset;
 
-    if (macho_info->export_off != 0) {
+    if (macho_info->export_off != 0 && export_trie(tables) != NULL) {
         /* export table search */
-        uint8_t *export_trie = read_file_off(fp, macho_info->export_size, base_offset + macho_info->export_off);
-        symbol_address = trie_query(export_trie, symbol_name);
-        free(export_trie);
+        symbol_address = trie_query(export_trie(tables), symbol_name);
         if (symbol_address != 0) {
             /* trie value is the location from mach_header */
             symbol_address += base_offset;
+            *source = SOURCE_EXPORT;
             goto ret;
         }
     }
 
-    /* these tables are both needed for symtab search and symbol stubs search */
-    const struct nlist_64* nl_tbl = read_file_off(fp, macho_info->nsyms * sizeof(struct nlist_64), base_offset + macho_info->symoff);
-    const char* str_tbl = read_file_off(fp, macho_info->strsize, base_offset + macho_info->stroff);
+    if (!read_symtab(tables))
+        goto ret;
+    const struct nlist_64* nl_tbl = tables->nl_tbl;
+    symtab_scan_t scan;
+    init_symtab_scan(&scan, macho_info, nl_tbl, tables->str_tbl, symbol_name);
 
-    if (macho_info->indirectsymoff != 0 && macho_info->stubs_off != 0) {
+    if (macho_info->indirectsymoff != 0 && macho_info->stubs_off != 0 && stub_entries(tables) != NULL) {
         /* symbol stubs search */
-        uint32_t entry_off = macho_info->indirectsymoff + macho_info->indirectsym_idx * sizeof(uint32_t);
         uint64_t nstubs = macho_info->stubs_size / macho_info->stub_len;
-        const uint32_t *indirectsym_entry = read_file_off(fp, nstubs * sizeof(uint32_t), base_offset + entry_off);
+        const uint32_t *indirectsym_entry = stub_entries(tables);
         for (int i = 0; i < nstubs; i++) {
             uint32_t nl_idx = indirectsym_entry[i];
-            if (strcmp(symbol_name, str_tbl + nl_tbl[nl_idx].n_un.n_strx) == 0) {
+            /* INDIRECT_SYMBOL_LOCAL / ABS entries are out of range too */
+            if (nl_idx >= macho_info->nsyms)
+                continue;
+            if (match_name(&scan, nl_tbl[nl_idx].n_un.n_strx)) {
                 /* stubs_off is direct file offset */
                 symbol_address = base_offset + macho_info->stubs_off + i * (uint64_t)macho_info->stub_len;
+                *source = SOURCE_STUB;
                 break;
             }
         }
-        free((void *)indirectsym_entry);
         if (symbol_address != 0)
-            goto sym_ret;
+            goto ret;
     }
 
     if (macho_info->symoff != 0) {
         /* symtab search */
-        for (int i = 0; i < macho_info->nsyms; i++) {
-            if ((nl_tbl[i].n_type & N_TYPE) != N_SECT) 
-                continue;
-            if (strcmp(symbol_name, str_tbl + nl_tbl[i].n_un.n_strx) == 0) {
-                /* n_value in nlist is the offset from vmaddr of the image */
-                symbol_address = base_offset + macho_info->vm_slide + nl_tbl[i].n_value;
-                goto sym_ret;
-            }
+        uint32_t idx = scan_symtab(&scan, macho_info->nsyms);
+        if (idx < macho_info->nsyms) {
+            /* n_value in nlist is the offset from vmaddr of the image */
+            symbol_address = base_offset + macho_info->vm_slide + nl_tbl[idx].n_value;
+            *source = SOURCE_SYMTAB;
+            goto ret;
         }
     }
 
-sym_ret:
-    free((void *)nl_tbl);
-    free((void *)str_tbl);
-
 ret:
     return (long)symbol_address;
 }
@@ -0,0 +1,243 @@
+#include "private.h"
+#include "fileio.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/*
+ * the undo log of a binary, appended to before its sites are written:
+ *   for each patched site: undo_record_t, then the original bytes (padded to 8 bytes)
+ * it is kept in the cache directory, or next to the binary as <file>.symp-undo
+ * a revert restores the newest records first, so sites patched several times
+ * go back step by step, and rewrites the log with the records left
+ */
+
+#define UNDO_MAGIC 0x55504d53 /* "SMPU" */
+
+typedef struct {
+    uint32_t magic;
+    uint32_t len;          /* of the original bytes and of the patch */
+    int64_t fileoff;
+    int32_t cputype;
+    uint32_t reserved;
+    uint8_t uuid[16];      /* LC_UUID of the slice, all zero if unknown */
+    uint64_t patch_hash;   /* of the bytes written over the original ones */
+    uint64_t record_hash;  /* of the record and the original bytes, torn appends are dropped */
+} undo_record_t;
+
+static uint64_t record_hash(const undo_record_t *record) {
+    undo_record_t header = *record;
+    header.record_hash = 0;
+    uint64_t hash = hash_bytes(HASH_INIT, &header, sizeof(header));
+    return hash_bytes(hash, record + 1, record->len);
+}
+
+/* size of the complete records at the start of the log, a torn one ends it */
+static size_t complete_size(const uint8_t *log, size_t size) {
+    size_t pos = 0;
+    while (size - pos >= sizeof(undo_record_t)) {
+        const undo_record_t *record = (const void *)(log + pos);
+        if (record->magic != UNDO_MAGIC || PAD8(record->len) > size - pos - sizeof(undo_record_t) ||
+            record->record_hash != record_hash(record))
+            break;
+        pos += sizeof(undo_record_t) + PAD8(record->len);
+    }
+    return pos;
+}
+
+/* cut a torn record left by a crash, the next appends would be lost behind it */
+static int drop_torn_tail(int fd, const char *log_path) {
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+        return 1;
+    if (st.st_size == 0)
+        return 0;
+    uint8_t *log = malloc(st.st_size);
+    int error = pread(fd, log, st.st_size, 0) != st.st_size;
+    if (!error) {
+        const size_t complete = complete_size(log, st.st_size);
+        if (complete != (size_t)st.st_size) {
+            fprintf(stderr, "symp: %s: dropped a torn record\n", log_path);
+            error = ftruncate(fd, complete) != 0;
+        }
+    }
+    free(log);
+    return error;
+}
+
+static char *undo_log_path(const char *path) {
+    char full_path[PATH_MAX];
+    if (realpath(path, full_path) == NULL)
+        return NULL;
+    char name[64];
+    snprintf(name, sizeof(name), "undo-%016llx.log",
+             (unsigned long long)hash_update(HASH_INIT, full_path));
+    char *log_path = cache_file_path(name);
+    if (log_path == NULL) {
+        log_path = malloc(strlen(full_path) + sizeof(".symp-undo"));
+        strcpy(log_path, full_path);
+        strcat(log_path, ".symp-undo");
+    }
+    return log_path;
+}
+
+int record_undo(const char *path, patch_site_t *const *sites, const uint8_t *const *originals, int nsites) {
+    if (nsites == 0)
+        return 0;
+    size_t size = 0;
+    for (int i = 0; i < nsites; i++)
+        size += sizeof(undo_record_t) + PAD8(sites[i]->patch->len);
+    uint8_t *buf = calloc(1, size);
+    uint8_t *cur_pos = buf;
+    for (int i = 0; i < nsites; i++) {
+        const patch_site_t *site = sites[i];
+        undo_record_t *record = (void *)cur_pos;
+        record->magic = UNDO_MAGIC;
+        record->len = site->patch->len;
+        record->fileoff = site->poff.fileoff;
+        record->cputype = site->poff.cputype;
+        if (site->uuid != NULL)
+            memcpy(record->uuid, site->uuid, sizeof(record->uuid));
+        record->patch_hash = hash_bytes(HASH_INIT, site->patch->buf, site->patch->len);
+        memcpy(record + 1, originals[i], site->patch->len);
+        record->record_hash = record_hash(record);
+        cur_pos += sizeof(undo_record_t) + PAD8(record->len);
+    }
+
+    int error = 1;
+    char *log_path = undo_log_path(path);
+    int fd = log_path != NULL ? open(log_path, O_RDWR | O_APPEND | O_CREAT, 0644) : -1;
+    if (fd >= 0 && drop_torn_tail(fd, log_path) == 0) {
+        /* a single append, so a record is either complete or dropped as torn */
+        ssize_t ret;
+        while ((ret = write(fd, buf, size)) < 0 && errno == EINTR)
+            ;
+        error = ret < 0 || (size_t)ret != size || fsync(fd) != 0;
+    }
+    if (fd >= 0)
+        close(fd);
+    if (error)
+        fprintf(stderr, "symp: can not record the original bytes of %s, not patched\n", path);
+    free(log_path);
+    free(buf);
+    return error;
+}
+
+/* is the slice of the record still in the file, always true if its UUID is unknown */
+static bool same_image(const slice_scan_t *scan, const undo_record_t *record) {
+    static const uint8_t zero_uuid[16] = {0};
+    if (memcmp(record->uuid, zero_uuid, sizeof(zero_uuid)) == 0)
+        return true;
+    for (int i = 0; i < scan->nslices; i++) {
+        const slice_id_t *slice = &scan->slices[i];
+        if (slice->cputype == record->cputype && memcmp(slice->uuid, record->uuid, sizeof(record->uuid)) == 0)
+            return true;
+    }
+    return false;
+}
+
+/* restore the original bytes of a record, 0 if reverted */
+static int revert_record(FILE *fp, const undo_record_t *record) {
+    int error = 1;
+    uint8_t *current = malloc(record->len ? record->len : 1);
+    if (fseek(fp, record->fileoff, SEEK_SET) != 0 || fread(current, record->len, 1, fp) != 1)
+        fprintf(stderr, "symp: can not read the bytes at 0x%llx\n", (long long)record->fileoff);
+    else if (hash_bytes(HASH_INIT, current, record->len) != record->patch_hash)
+        fprintf(stderr, "symp: bytes at 0x%llx are not the patch anymore, not reverted\n", (long long)record->fileoff);
+    else {
+        if (fseek(fp, record->fileoff, SEEK_SET) == 0 && fwrite(record + 1, record->len, 1, fp) == 1)
+            error = 0;
+        else
+            perror("fwrite");
+    }
+    free(current);
+    return error;
+}
+
+int revert_file(const char *path) {
+    char *log_path = undo_log_path(path);
+    FILE *log_fp = log_path != NULL ? fopen(log_path, "rb") : NULL;
+    if (log_fp == NULL) {
+        fprintf(stderr, "symp: no patch of %s to revert\n", path);
+        free(log_path);
+        return 1;
+    }
+    fseek(log_fp, 0, SEEK_END);
+    long size = ftell(log_fp);
+    fseek(log_fp, 0, SEEK_SET);
+    uint8_t *log = size > 0 ? read_file(log_fp, size) : NULL;
+    fclose(log_fp);
+    FILE *fp = fopen(path, "rb+");
+    if (fp == NULL) {
+        perror("fopen");
+        free(log);
+        free(log_path);
+        return 1;
+    }
+    slice_scan_t scan;
+    scan_slices(fp, &scan); /* none for dyld shared caches, records have no UUID there */
+
+    /* complete records, a torn one ends the log */
+    const size_t complete = log != NULL ? complete_size(log, size) : 0;
+    if (log != NULL && complete != (size_t)size)
+        fprintf(stderr, "symp: %s: dropped a torn record\n", log_path);
+    int nrecords = 0;
+    undo_record_t **records = malloc((size / sizeof(undo_record_t) + 1) * sizeof(undo_record_t *));
+    for (size_t pos = 0; pos < complete; pos += sizeof(undo_record_t) + PAD8(records[nrecords - 1]->len))
+        records[nrecords++] = (void *)(log + pos);
+
+    int nreverted = 0, nerrors = 0;
+    bool *kept = calloc(nrecords ? nrecords : 1, sizeof(bool));
+    for (int i = nrecords - 1; i >= 0; i--) {
+        const undo_record_t *record = records[i];
+        if (o_patch_arch != 0 && (record->cputype & o_patch_arch) != record->cputype) {
+            kept[i] = true;
+            continue;
+        }
+        if (!same_image(&scan, record)) {
+            /* the binary was replaced since, the record can never apply again */
+            char *arch = arch2str(record->cputype);
+            fprintf(stderr, "symp: warning, image of arch '%s' changed, dropped the patch at 0x%llx\n",
+                    arch ? arch : "unknown", (long long)record->fileoff);
+            continue;
+        }
+        if (revert_record(fp, record) != 0) {
+            kept[i] = true;
+            nerrors++;
+            continue;
+        }
+        nreverted++;
+    }
+    fclose(fp);
+
+    /* keep the records not reverted, in order */
+    size_t kept_size = 0;
+    for (int i = 0; i < nrecords; i++) {
+        if (!kept[i])
+            continue;
+        const size_t len = sizeof(undo_record_t) + PAD8(records[i]->len);
+        memmove(log + kept_size, records[i], len);
+        kept_size += len;
+    }
+    if (kept_size == 0)
+        unlink(log_path);
+    else if (write_file_atomic(log_path, log, kept_size) != 0)
+        fprintf(stderr, "symp: can not update %s\n", log_path);
+
+    if (!o_quiet) {
+        if (nreverted == 1)
+            printf("1(%d) match reverted\n", nreverted + nerrors);
+        else
+            printf("%d(%d) matches reverted\n", nreverted, nreverted + nerrors);
+    }
+    free(kept);
+    free(records);
+    free(log);
+    free(log_path);
+    return nerrors != 0 || nreverted == 0;
+}
@@ -0,0 +1,328 @@
+#include "private.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#else
+#include <sys/event.h>
+#endif
+
+#define DEBOUNCE_MS 250
+
+/* the resolved sites of a slice, reused while its image stays the same */
+typedef struct {
+    bool done;            /* every entry of the slice resolved and patched */
+    int nsites;
+    patch_site_t *sites;
+} slice_sites_t;
+
+typedef struct {
+    char *path;
+    char *dir;         /* parent directory */
+    const char *name;  /* file name in dir */
+    ino_t ino;         /* 0 before the first patch */
+    slice_scan_t state;
+    slice_sites_t sites[MAX_SLICES];  /* of the slices of state */
+    bool dirty;
+    int wd;            /* inotify watch of dir, or the watched fd of the file */
+    int dir_fd;        /* watched fd of dir (kqueue only) */
+} watched_file_t;
+
+/* (g)lobals */
+static manifest_t *g_manifest;
+static watched_file_t *g_files;
+static int g_nfiles = 0;
+
+/*
+ * re-resolve the slices changed since the last time, then patch all of them,
+ * the bytes of an unchanged image are checked again, an update may rewrite it in place
+ */
+static void apply_file(watched_file_t *file) {
+    static const uint8_t zero_uuid[16] = {0};
+    FILE *fp = fopen(file->path, "rb+");
+    if (fp == NULL)
+        return; /* being replaced, wait for the next event */
+    struct stat st;
+    slice_scan_t scan = {0};
+    if (fstat(fileno(fp), &st) != 0 || scan_slices(fp, &scan) <= 0) {
+        fclose(fp); /* not complete yet */
+        return;
+    }
+
+    int nsites = 0;
+    int first_site[MAX_SLICES + 1];
+    bool resolved[MAX_SLICES];
+    patch_site_t *sites = malloc((g_manifest->nentries * scan.nslices + 1) * sizeof(patch_site_t));
+    const manifest_entry_t **entries = malloc(g_manifest->nentries * sizeof(manifest_entry_t *));
+    char **symbol_names = malloc(g_manifest->nentries * sizeof(char *));
+    patch_off_t *poffs = malloc(g_manifest->nentries * sizeof(patch_off_t));
+    bool *found = malloc(g_manifest->nentries * sizeof(bool));
+    const bool replaced = st.st_ino != file->ino;
+    for (int i = 0; i < scan.nslices; i++) {
+        const slice_id_t *slice = &scan.slices[i];
+        first_site[i] = nsites;
+        resolved[i] = true;
+        if (o_patch_arch != 0 && (slice->cputype & o_patch_arch) != slice->cputype)
+            continue;
+        /* same image as last time, e.g. the event of our own writes, its symbols are resolved already */
+        const slice_sites_t *cached = &file->sites[i];
+        if (!replaced && i < file->state.nslices && cached->done &&
+            memcmp(slice->uuid, zero_uuid, sizeof(zero_uuid)) != 0 &&
+            memcmp(slice->uuid, file->state.slices[i].uuid, sizeof(slice->uuid)) == 0) {
+            memcpy(&sites[nsites], cached->sites, cached->nsites * sizeof(patch_site_t));
+            nsites += cached->nsites;
+            continue;
+        }
+        /* the symbols of a slice are resolved at once, its tables are read once */
+        int nsymbols = 0;
+        for (int j = 0; j < g_manifest->nentries; j++) {
+            const manifest_entry_t *entry = &g_manifest->entries[j];
+            if (manifest_patch(entry, slice->cputype) == NULL || strcmp(entry->file, file->path) != 0)
+                continue;
+            entries[nsymbols] = entry;
+            symbol_names[nsymbols++] = entry->symbol;
+        }
+        fseek(fp, slice->offset, SEEK_SET);
+        lookup_symbols_macho(fp, symbol_names, nsymbols, poffs, found);
+        for (int j = 0; j < nsymbols; j++) {
+            if (!found[j]) {
+                char *arch = arch2str(slice->cputype);
+                fprintf(stderr, "symp: %s: symbol '%s' not found for arch '%s'!\n",
+                        file->path, symbol_names[j], arch ? arch : "unknown");
+                resolved[i] = false;
+                continue;
+            }
+            patch_site_t *site = &sites[nsites++];
+            site->poff = poffs[j];
+            site->patch = manifest_patch(entries[j], slice->cputype);
+            site->expect = manifest_expect(entries[j], slice->cputype);
+            site->uuid = slice->uuid;
+        }
+    }
+    first_site[scan.nslices] = nsites;
+    free(entries);
+    free(symbol_names);
+    free(poffs);
+    free(found);
+    patch_file(fp, file->path, sites, nsites);
+    fclose(fp);
+
+    /*
+     * keep the slices whose entries all resolved and are patched now,
+     * the others may have been read half written and are retried on the next event
+     */
+    file->ino = st.st_ino;
+    file->state = scan;
+    for (int i = 0; i < MAX_SLICES; i++) {
+        slice_sites_t *kept = &file->sites[i];
+        free(kept->sites);
+        memset(kept, 0, sizeof(slice_sites_t));
+        if (i >= scan.nslices || !resolved[i])
+            continue;
+        kept->done = true;
+        for (int j = first_site[i]; j < first_site[i + 1]; j++) {
+            if (sites[j].status == PATCH_ERROR)
+                kept->done = false;
+        }
+        if (!kept->done)
+            continue;
+        kept->nsites = first_site[i + 1] - first_site[i];
+        kept->sites = malloc((kept->nsites + 1) * sizeof(patch_site_t));
+        memcpy(kept->sites, &sites[first_site[i]], kept->nsites * sizeof(patch_site_t));
+        for (int j = 0; j < kept->nsites; j++)
+            kept->sites[j].uuid = file->state.slices[i].uuid;
+    }
+
+    int npatched = 0, nalready = 0;
+    for (int i = 0; i < nsites; i++) {
+        if (sites[i].status == PATCH_WRITTEN)
+            npatched++;
+        else if (sites[i].status == PATCH_ALREADY)
+            nalready++;
+    }
+    free(sites);
+    if (npatched != 0 && !o_quiet) {
+        printf("%s: %d(%d) matches patched", file->path, npatched, nsites);
+        if (nalready != 0)
+            printf(", %d already-patched", nalready);
+        printf("\n");
+        fflush(stdout);
+    }
+}
+
+static void apply_dirty_files(void) {
+    for (int i = 0; i < g_nfiles; i++) {
+        if (g_files[i].dirty) {
+            g_files[i].dirty = false;
+            apply_file(&g_files[i]);
+        }
+    }
+}
+
+#ifdef __linux__
+
+static int watch_loop(void) {
+    int ifd = inotify_init1(IN_CLOEXEC);
+    if (ifd < 0) {
+        perror("inotify_init1");
+        return 1;
+    }
+    /* watch the directories, so files replaced by rename are still seen */
+    for (int i = 0; i < g_nfiles; i++) {
+        g_files[i].wd = inotify_add_watch(ifd, g_files[i].dir, IN_CLOSE_WRITE | IN_MODIFY | IN_CREATE | IN_MOVED_TO);
+        if (g_files[i].wd < 0) {
+            perror("inotify_add_watch");
+            close(ifd);
+            return 1;
+        }
+    }
+
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    bool pending = false;
+    while (1) {
+        struct pollfd pfd = {ifd, POLLIN, 0};
+        int ret = poll(&pfd, 1, pending ? DEBOUNCE_MS : -1);
+        if (ret < 0 && errno == EINTR)
+            continue;
+        if (ret < 0) {
+            perror("poll");
+            break;
+        }
+        if (ret == 0) { /* quiet for DEBOUNCE_MS */
+            pending = false;
+            apply_dirty_files();
+            continue;
+        }
+        ssize_t len = read(ifd, buf, sizeof(buf));
+        if (len < 0 && errno == EINTR)
+            continue;
+        if (len <= 0) {
+            perror("read");
+            break;
+        }
+        for (char *p = buf; p < buf + len; ) {
+            const struct inotify_event *event = (void *)p;
+            for (int i = 0; i < g_nfiles; i++) {
+                if (g_files[i].wd == event->wd && event->len != 0 && strcmp(g_files[i].name, event->name) == 0)
+                    g_files[i].dirty = pending = true;
+            }
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+    close(ifd);
+    return 1;
+}
+
+#else
+
+/* (re)open the file to follow it after being replaced */
+static void watch_file_fd(int kq, int idx) {
+    watched_file_t *file = &g_files[idx];
+    if (file->wd >= 0)
+        close(file->wd);
+    file->wd = open(file->path, O_EVTONLY);
+    if (file->wd < 0)
+        return; /* seen again by the directory event */
+    struct kevent change;
+    EV_SET(&change, file->wd, EVFILT_VNODE, EV_ADD | EV_CLEAR,
+           NOTE_WRITE | NOTE_EXTEND | NOTE_DELETE | NOTE_RENAME, 0, (void *)(intptr_t)idx);
+    kevent(kq, &change, 1, NULL, 0, NULL);
+}
+
+static int watch_loop(void) {
+    int kq = kqueue();
+    if (kq < 0) {
+        perror("kqueue");
+        return 1;
+    }
+    for (int i = 0; i < g_nfiles; i++) {
+        /* directory events catch files replaced by rename */
+        g_files[i].dir_fd = open(g_files[i].dir, O_EVTONLY);
+        if (g_files[i].dir_fd < 0) {
+            perror("open");
+            close(kq);
+            return 1;
+        }
+        struct kevent change;
+        EV_SET(&change, g_files[i].dir_fd, EVFILT_VNODE, EV_ADD | EV_CLEAR,
+               NOTE_WRITE, 0, (void *)(intptr_t)i);
+        kevent(kq, &change, 1, NULL, 0, NULL);
+        watch_file_fd(kq, i);
+    }
+
+    struct kevent events[64];
+    const struct timespec debounce = {0, DEBOUNCE_MS * 1000000L};
+    bool pending = false;
+    while (1) {
+        int nevents = kevent(kq, NULL, 0, events, ARRAY_LEN(events), pending ? &debounce : NULL);
+        if (nevents < 0 && errno == EINTR)
+            continue;
+        if (nevents < 0) {
+            perror("kevent");
+            break;
+        }
+        if (nevents == 0) { /* quiet for DEBOUNCE_MS */
+            pending = false;
+            for (int i = 0; i < g_nfiles; i++) {
+                if (g_files[i].dirty)
+                    watch_file_fd(kq, i);
+            }
+            apply_dirty_files();
+            continue;
+        }
+        for (int i = 0; i < nevents; i++)
+            g_files[(intptr_t)events[i].udata].dirty = pending = true;
+    }
+    close(kq);
+    return 1;
+}
+
+#endif
+
+int watch_manifest(const char *path) {
+    g_manifest = load_manifest(path);
+    if (g_manifest == NULL)
+        return 1;
+
+    /* one watched file for each distinct path */
+    g_files = calloc(g_manifest->nentries, sizeof(watched_file_t));
+    for (int i = 0; i < g_manifest->nentries; i++) {
+        const char *file_path = g_manifest->entries[i].file;
+        int j = 0;
+        while (j < g_nfiles && strcmp(g_files[j].path, file_path) != 0)
+            j++;
+        if (j < g_nfiles)
+            continue;
+        watched_file_t *file = &g_files[g_nfiles++];
+        file->path = strdup(file_path);
+        const char *slash = strrchr(file->path, '/');
+        if (slash == NULL) {
+            file->dir = strdup(".");
+            file->name = file->path;
+        }
+        else {
+            file->dir = strndup(file->path, slash == file->path ? 1 : slash - file->path);
+            file->name = slash + 1;
+        }
+        file->wd = file->dir_fd = -1;
+        file->dirty = true; /* patch everything once at start */
+    }
+
+    apply_dirty_files();
+    int error = watch_loop();
+
+    for (int i = 0; i < g_nfiles; i++) {
+        for (int j = 0; j < MAX_SLICES; j++)
+            free(g_files[i].sites[j].sites);
+        free(g_files[i].path);
+        free(g_files[i].dir);
+    }
+    free(g_files);
+    free_manifest(g_manifest);
+    return error;
+}
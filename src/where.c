@@ -0,0 +1,106 @@
+/* nftw and FTW_PHYS are XSI extensions on glibc */
+#define _XOPEN_SOURCE 700
+
+#include "private.h"
+#include "sym/resolve.h"
+
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* (g)lobals, nftw callbacks have no context */
+static const char *g_symbol_name;
+static char **g_paths = NULL;
+static int g_npaths = 0;
+static int g_nimages = 0;
+static int g_nskipped = 0;
+static int g_nmatches = 0;
+
+static int where_slice(FILE *fp, long offset, int32_t cputype, void *ctx) {
+    const char *path = ctx;
+    if (o_patch_arch != 0 && (cputype & o_patch_arch) != cputype)
+        return 0;
+    g_nimages++;
+    if (!maybe_defines_symbol_macho(fp, g_symbol_name)) {
+        g_nskipped++;
+        return 0;
+    }
+    /* confirm with the real lookup, imports are not definitions */
+    patch_off_t poff;
+    fseek(fp, offset, SEEK_SET);
+    if (!lookup_symbol_macho(fp, g_symbol_name, &poff) || poff.source == SOURCE_STUB)
+        return 0;
+    if (o_json) {
+        json_record(path, g_symbol_name, &poff);
+        return 1;
+    }
+    char *arch = arch2str(cputype);
+    printf("%s (%s) 0x%lx\n", path, arch ? arch : "unknown", poff.fileoff);
+    return 1;
+}
+
+static int collect_file(const char *path, const struct stat *sb, int typeflag, struct FTW *ftwbuf) {
+    static int cap = 0;
+    if (typeflag != FTW_F)
+        return 0;
+    if (g_npaths == cap) {
+        cap = cap ? cap * 2 : 256;
+        g_paths = realloc(g_paths, cap * sizeof(char *));
+    }
+    g_paths[g_npaths++] = strdup(path);
+    return 0;
+}
+
+static void where_file(const char *path) {
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+        return; /* unreadable files are skipped */
+    int found = for_each_slice(fp, where_slice, (void *)path);
+    if (found > 0)
+        g_nmatches += found;
+    fclose(fp);
+}
+
+/* images with a cached bloom filter are mostly skipped by it, only their headers are needed */
+static bool need_symbol_tables(const uint8_t *uuid, int32_t cputype) {
+    if (o_patch_arch != 0 && (cputype & o_patch_arch) != cputype)
+        return false;
+    return !symbol_bloom_cached(uuid, cputype);
+}
+
+int where_symbol(const char *symbol_name, const char *dir) {
+    g_symbol_name = symbol_name;
+    /* walk first, so the files can be read ahead while the earlier ones are resolved */
+    int error = nftw(dir, collect_file, 64, FTW_PHYS) != 0;
+    if (error)
+        perror("nftw");
+    else {
+        prefetcher_t *pf = start_prefetch(g_paths, g_npaths, need_symbol_tables);
+        for (int i = 0; i < g_npaths; i++) {
+            wait_prefetch(pf, i);
+            where_file(g_paths[i]);
+        }
+        stop_prefetch(pf);
+    }
+    for (int i = 0; i < g_npaths; i++)
+        free(g_paths[i]);
+    free(g_paths);
+    if (o_json)
+        json_flush();
+    if (error)
+        return 1;
+    if (g_nmatches == 0) {
+        if (!o_json)
+            printf("no matches found!\n");
+        return 1;
+    }
+    if (!o_quiet && !o_json) {
+        if (g_nmatches == 1)
+            printf("1 match found");
+        else
+            printf("%d matches found", g_nmatches);
+        printf(" (%d of %d images skipped by bloom filter)\n", g_nskipped, g_nimages);
+    }
+    return 0;
+}